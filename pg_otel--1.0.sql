@@ -0,0 +1,40 @@
+-- vim: set expandtab shiftwidth=0 syntax=pgsql tabstop=2 :
+
+\echo Use "CREATE EXTENSION pg_otel" to load this file. \quit
+
+-- Statistics of the exporter since it started or since pg_otel_stat_reset().
+-- Export durations are counted in buckets no larger than each bound; the last
+-- count is everything larger than the last bound.
+CREATE FUNCTION pg_otel_stat(
+  OUT received bigint,
+  OUT exported bigint,
+  OUT dropped_ipc bigint,
+  OUT dropped_queue_full bigint,
+  OUT dropped_invalid bigint,
+  OUT dropped_oversized bigint,
+  OUT dropped_export bigint,
+  OUT suppressed bigint,
+  OUT collapsed bigint,
+  OUT ipc_bytes bigint,
+  OUT bytes_sent bigint,
+  OUT exports_in_flight integer,
+  OUT last_error text,
+  OUT last_error_time timestamptz,
+  OUT last_success_time timestamptz,
+  OUT export_duration_bounds double precision[],
+  OUT export_duration_counts bigint[],
+  OUT export_duration_sum double precision,
+  OUT stats_reset timestamptz
+)
+RETURNS record
+AS 'MODULE_PATHNAME', 'otel_StatFunction'
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE;
+
+CREATE VIEW pg_otel_stat AS SELECT * FROM pg_otel_stat();
+
+CREATE FUNCTION pg_otel_stat_reset() RETURNS void
+AS 'MODULE_PATHNAME', 'otel_StatResetFunction'
+LANGUAGE C STRICT VOLATILE PARALLEL RESTRICTED;
+
+-- Only superusers can reset statistics unless granted otherwise
+REVOKE ALL ON FUNCTION pg_otel_stat_reset() FROM PUBLIC;
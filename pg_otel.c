@@ -2,19 +2,30 @@
 
 #include "postgres.h"
 
+#include "access/xact.h"
+#include "executor/executor.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "postmaster/bgworker.h"
 #include "storage/ipc.h"
 #include "storage/latch.h"
 #include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "utils/elog.h"
+#include "utils/memutils.h"
 
 #include "curl/curl.h"
 
 #include "pg_otel.h"
 #include "pg_otel_config.c"
+#include "pg_otel_limit.c"
 #include "pg_otel_logs.c"
+#include "pg_otel_metrics.c"
+#include "pg_otel_pipeline.c"
 #include "pg_otel_proto.c"
+#include "pg_otel_spill.c"
+#include "pg_otel_stat.c"
+#include "pg_otel_statement.c"
 #include "pg_otel_worker.c"
 
 /* Dynamically loadable module */
@@ -35,8 +46,14 @@ PGDLLEXPORT void _PG_fini(void) {}
 /* BackgroundWorker entry point */
 PGDLLEXPORT void otel_WorkerMain(Datum arg) pg_attribute_noreturn();
 
+/* SQL functions; see pg_otel--1.0.sql */
+PG_FUNCTION_INFO_V1(otel_StatFunction);
+PG_FUNCTION_INFO_V1(otel_StatResetFunction);
+
 /* Hooks overridden by this module */
 static emit_log_hook_type next_EmitLogHook = NULL;
+static ExecutorEnd_hook_type prev_ExecutorEndHook = NULL;
+static shmem_startup_hook_type prev_SharedMemoryStartupHook = NULL;
 #if PG_VERSION_NUM >= 150000
 static shmem_request_hook_type prev_SharedMemoryRequestHook = NULL;
 #endif
@@ -44,7 +61,7 @@ static shmem_request_hook_type prev_SharedMemoryRequestHook = NULL;
 /* Variables set via GUC (parameters) */
 static struct otelConfiguration config;
 
-/* Values shared between backends and the background worker */
+/* Values shared between backends and the background workers */
 static struct otelWorker worker;
 
 /* Signal handler; see [otel_WorkerMain] */
@@ -78,14 +95,55 @@ otel_EmitLogHook(ErrorData *edata)
 	 * the exporter *to* the exporter could cause a feedback loop, so don't
 	 * do that. These messages still go to the next log processor which is
 	 * usually PostgreSQL's built-in logging_collector or stderr.
+	 *
+	 * Messages that are filtered by severity or SQLSTATE are skipped before
+	 * any shared memory is touched.
 	 */
-	if (config.exports.signals & PG_OTEL_CONFIG_LOGS && MyProcPid != worker.pid)
-		otel_SendLogMessage(&worker.ipc, edata);
+	if (config.exports.signals & PG_OTEL_CONFIG_LOGS && MyProcPid != worker.pid &&
+		otel_WantLogMessage(&config, edata->elevel, edata->sqlerrcode) &&
+		otel_AllowLogMessage(worker.limit, &config, edata->elevel))
+	{
+		int channel = otel_WorkerChannel(&worker);
+
+		otel_SendLogMessage(&worker.channels[channel],
+							worker.statements ? &worker.statements[channel] : NULL,
+							edata, &config);
+
+		/*
+		 * Hold messages until the end of the statement or transaction, when
+		 * there is one. Send errors right away.
+		 */
+		if (edata->elevel >= ERROR || !IsTransactionState())
+			otel_FlushIPC(&worker.channels[channel]);
+	}
 
 	if (next_EmitLogHook)
 		next_EmitLogHook(edata);
 }
 
+/*
+ * Called at the end of each statement that uses the executor.
+ */
+static void
+otel_ExecutorEndHook(QueryDesc *queryDesc)
+{
+	if (prev_ExecutorEndHook)
+		prev_ExecutorEndHook(queryDesc);
+	else
+		standard_ExecutorEnd(queryDesc);
+
+	otel_FlushIPC(otel_WorkerIPC(&worker));
+}
+
+/*
+ * Called at stages of every transaction, including its end.
+ */
+static void
+otel_TransactionCallback(XactEvent event, void *arg)
+{
+	otel_FlushIPC(otel_WorkerIPC(&worker));
+}
+
 /*
  * Called after client backends and background workers have stopped, when
  * postmaster is shutting down.
@@ -98,13 +156,16 @@ otel_ProcExitHook(int code, Datum arg)
 		return;
 
 	/*
-	 * Some telemetry data is emitted even after the background worker has
+	 * Some telemetry data is emitted even after the background workers have
 	 * stopped. Notice when any further data is from postmaster itself, and
-	 * flush the pipe.
+	 * flush every pipe.
 	 */
 	worker.pid = MyProcPid;
-	otel_CloseWrite(&worker.ipc);
-	otel_WorkerDrain(&worker, &config);
+	for (int i = 0; i < worker.channelsLength; i++)
+		otel_CloseWrite(&worker.channels[i]);
+
+	for (int i = 0; i < worker.channelsLength; i++)
+		otel_WorkerDrain(&worker, &config, i, true);
 
 	/*
 	 * Finish with libcurl. It was initialized during [_PG_init].
@@ -113,6 +174,40 @@ otel_ProcExitHook(int code, Datum arg)
 	curl_global_cleanup();
 }
 
+/*
+ * Called before shared memory is detached in every process. Postmaster does
+ * this before calling any on_proc_exit hooks, so it must send anything left
+ * in shared memory now.
+ */
+static void
+otel_SharedMemoryExitHook(int code, Datum arg)
+{
+	/* Nothing to do when postmaster is reinitializing after a crash */
+	if (MyProcPid != PostmasterPid || !proc_exit_inprogress)
+		return;
+
+	for (int i = 0; i < worker.channelsLength; i++)
+		if (worker.channels[i].ring != NULL)
+			otel_WorkerDrain(&worker, &config, i, false);
+
+	for (int i = 0; i < worker.channelsLength; i++)
+		otel_DetachSharedMemory(&worker.channels[i]);
+
+	worker.limit = NULL;
+	worker.stat = NULL;
+	worker.statements = NULL;
+}
+
+/* The number of bytes to allocate for the ring of each channel, if any */
+static Size
+otel_RingCapacity(void)
+{
+	if (config.ipc.method != PG_OTEL_CONFIG_IPC_SHARED_MEMORY)
+		return 0;
+
+	return (Size) config.ipc.bufferSizeKB * 1024;
+}
+
 /*
  * Since PostgreSQL 15, this hook is called after shared_preload_libraries
  * are loaded (so their GUCs exist) and before shared memory and semaphores
@@ -122,12 +217,86 @@ otel_ProcExitHook(int code, Datum arg)
 static void
 otel_SharedMemoryRequestHook(void)
 {
+	Size size = mul_size(otel_IPCSharedMemorySize(otel_RingCapacity()),
+						 worker.channelsLength);
+
 #if PG_VERSION_NUM >= 150000
 	if (prev_SharedMemoryRequestHook)
 		prev_SharedMemoryRequestHook();
 #endif
 
-	/* no-op */
+	size = add_size(size, otel_LimitSharedMemorySize());
+	size = add_size(size, otel_StatSharedMemorySize(worker.channelsLength));
+	size = add_size(size, otel_StatementsSharedMemorySize(worker.channelsLength));
+
+	RequestAddinShmemSpace(size);
+}
+
+/*
+ * Called after shared memory is created in postmaster, and again after it is
+ * reinitialized following a crash.
+ */
+static void
+otel_SharedMemoryStartupHook(void)
+{
+	if (prev_SharedMemoryStartupHook)
+		prev_SharedMemoryStartupHook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	for (int i = 0; i < worker.channelsLength; i++)
+		otel_AttachSharedMemory(&worker.channels[i], otel_RingCapacity(), i);
+	worker.limit = otel_AttachLimit();
+	worker.stat = otel_AttachStat(worker.channelsLength);
+	worker.statements = otel_AttachStatements(worker.channelsLength);
+	LWLockRelease(AddinShmemInitLock);
+
+	otel_InitWaitEvents();
+
+	if (!IsUnderPostmaster)
+		on_shmem_exit(otel_SharedMemoryExitHook, 0);
+}
+
+/* Statistics are in shared memory only when loaded at server start */
+static void
+otel_CheckStat(void)
+{
+	if (worker.stat == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pg_otel must be loaded via \"shared_preload_libraries\"")));
+}
+
+/*
+ * Called by the pg_otel_stat() SQL function.
+ */
+Datum
+otel_StatFunction(PG_FUNCTION_ARGS)
+{
+	struct otelStat snapshot;
+	TupleDesc tupdesc;
+
+	otel_CheckStat();
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	otel_ReadStat(worker.stat, worker.channelsLength, &snapshot);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(otel_StatTuple(&snapshot,
+													 BlessTupleDesc(tupdesc))));
+}
+
+/*
+ * Called by the pg_otel_stat_reset() SQL function.
+ */
+Datum
+otel_StatResetFunction(PG_FUNCTION_ARGS)
+{
+	otel_CheckStat();
+	for (int i = 0; i < worker.channelsLength; i++)
+		otel_ResetStat(&worker.stat[i], &worker.channels[i]);
+
+	PG_RETURN_VOID();
 }
 
 /*
@@ -144,9 +313,10 @@ otel_WorkerMain(Datum arg)
 	BackgroundWorkerUnblockSignals();
 
 	/* Notice when telemetry data is from the worker itself */
+	worker.channel = DatumGetInt32(arg);
 	worker.pid = MyProcPid;
 
-	otel_CloseWrite(&worker.ipc);
+	otel_CloseWrite(&worker.channels[worker.channel]);
 	otel_WorkerRun(&worker, &config);
 
 	/* Exit zero so we aren't restarted */
@@ -171,19 +341,32 @@ _PG_init(void)
 
 	otel_DefineCustomVariables();
 	otel_ReadEnvironment();
-	otel_OpenIPC(&worker.ipc);
+
+	/* Each exporter has its own channel; see [otel_WorkerChannel] */
+	worker.channelsLength = config.exporterWorkers;
+	worker.channels = MemoryContextAllocZero(TopMemoryContext,
+											 sizeof(struct otelIPC) * worker.channelsLength);
+	for (int i = 0; i < worker.channelsLength; i++)
+		otel_OpenIPC(&worker.channels[i]);
 
 	/*
-	 * Register our background worker to start immediately. Restart it without
-	 * delay if it crashes.
+	 * Register our background workers to start immediately. Restart them
+	 * without delay if they crash.
 	 */
-	MemSet(&exporter, 0, sizeof(BackgroundWorker));
-	exporter.bgw_flags = BGWORKER_SHMEM_ACCESS;
-	exporter.bgw_start_time = BgWorkerStart_PostmasterStart;
-	snprintf(exporter.bgw_name, BGW_MAXLEN, "OpenTelemetry exporter");
-	snprintf(exporter.bgw_library_name, BGW_MAXLEN, PG_OTEL_LIBRARY);
-	snprintf(exporter.bgw_function_name, BGW_MAXLEN, "otel_WorkerMain");
-	RegisterBackgroundWorker(&exporter);
+	for (int i = 0; i < worker.channelsLength; i++)
+	{
+		MemSet(&exporter, 0, sizeof(BackgroundWorker));
+		exporter.bgw_flags = BGWORKER_SHMEM_ACCESS;
+		exporter.bgw_start_time = BgWorkerStart_PostmasterStart;
+		exporter.bgw_main_arg = Int32GetDatum(i);
+		if (worker.channelsLength > 1)
+			snprintf(exporter.bgw_name, BGW_MAXLEN, "OpenTelemetry exporter %d", i);
+		else
+			snprintf(exporter.bgw_name, BGW_MAXLEN, "OpenTelemetry exporter");
+		snprintf(exporter.bgw_library_name, BGW_MAXLEN, PG_OTEL_LIBRARY);
+		snprintf(exporter.bgw_function_name, BGW_MAXLEN, "otel_WorkerMain");
+		RegisterBackgroundWorker(&exporter);
+	}
 
 	/* Request locks and other shared resources */
 #if PG_VERSION_NUM >= 150000
@@ -192,6 +375,8 @@ _PG_init(void)
 #else
 	otel_SharedMemoryRequestHook();
 #endif
+	prev_SharedMemoryStartupHook = shmem_startup_hook;
+	shmem_startup_hook = otel_SharedMemoryStartupHook;
 
 	/* Cleanup on postmaster exit */
 	on_proc_exit(otel_ProcExitHook, 0);
@@ -199,4 +384,9 @@ _PG_init(void)
 	/* Install our log processor */
 	next_EmitLogHook = emit_log_hook;
 	emit_log_hook = otel_EmitLogHook;
+
+	/* Send log messages at the end of statements and transactions */
+	prev_ExecutorEndHook = ExecutorEnd_hook;
+	ExecutorEnd_hook = otel_ExecutorEndHook;
+	RegisterXactCallback(otel_TransactionCallback, NULL);
 }
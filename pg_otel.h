@@ -6,6 +6,9 @@
 #define PG_OTEL_LIBRARY "pg_otel"
 #define PG_OTEL_VERSION "0.0.1"
 
+#define PG_OTEL_GRPC_LOGS_EXPORT "/opentelemetry.proto.collector.logs.v1.LogsService/Export"
+#define PG_OTEL_GRPC_METRICS_EXPORT "/opentelemetry.proto.collector.metrics.v1.MetricsService/Export"
+#define PG_OTEL_HEADER_GRPC "Content-Type: application/grpc"
 #define PG_OTEL_HEADER_PROTOBUF "Content-Type: application/x-protobuf"
 #define PG_OTEL_SCHEMA "https://opentelemetry.io/schemas/1.9.0"
 #define PG_OTEL_USERAGENT PG_OTEL_LIBRARY "/" PG_OTEL_VERSION
@@ -1,8 +1,10 @@
 /* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
 
 #include "postgres.h"
+#include "mb/pg_wchar.h"
 #include "parser/scansup.h"
 #include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/varlena.h"
 
 #include "curl/curl.h"
@@ -34,6 +36,49 @@ static char *guc_strdup(int elevel, const char *src)
 }
 #endif
 
+static const struct config_enum_entry otel_CompressionOptions[] = {
+	{"none", PG_OTEL_CONFIG_COMPRESSION_NONE, false},
+	{"gzip", PG_OTEL_CONFIG_COMPRESSION_GZIP, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry otel_ProtocolOptions[] = {
+	{"http/protobuf", PG_OTEL_CONFIG_PROTOCOL_HTTP_PROTOBUF, false},
+	{"grpc", PG_OTEL_CONFIG_PROTOCOL_GRPC, false},
+	{NULL, 0, false}
+};
+
+/* These are in the same order as their elevel */
+static const struct config_enum_entry otel_LogLevelOptions[] = {
+	{"debug5", DEBUG5, false},
+	{"debug4", DEBUG4, false},
+	{"debug3", DEBUG3, false},
+	{"debug2", DEBUG2, false},
+	{"debug1", DEBUG1, false},
+	{"debug", DEBUG2, true},
+	{"log", LOG, false},
+	{"info", INFO, false},
+	{"notice", NOTICE, false},
+	{"warning", WARNING, false},
+	{"error", ERROR, false},
+	{"fatal", FATAL, false},
+	{"panic", PANIC, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry otel_StatementDedupOptions[] = {
+	{"off", PG_OTEL_CONFIG_STATEMENT_DEDUP_OFF, false},
+	{"omit", PG_OTEL_CONFIG_STATEMENT_DEDUP_OMIT, false},
+	{"reattach", PG_OTEL_CONFIG_STATEMENT_DEDUP_REATTACH, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry otel_IPCMethodOptions[] = {
+	{"pipe", PG_OTEL_CONFIG_IPC_PIPE, false},
+	{"shared_memory", PG_OTEL_CONFIG_IPC_SHARED_MEMORY, false},
+	{NULL, 0, false}
+};
+
 /*
  * otel_ScanW3CBaggage parses a W3C Baggage key or value that begins at start.
  * It returns false when the string has an invalid character. When it returns
@@ -296,6 +341,38 @@ otel_CheckEndpoint(char **next, void **extra, GucSource source)
 	return true;
 }
 
+static bool
+otel_CheckHTTP2(bool *next, void **extra, GucSource source)
+{
+	curl_version_info_data *version = curl_version_info(CURLVERSION_NOW);
+
+	if (*next && !(version->features & CURL_VERSION_HTTP2))
+	{
+		GUC_check_errdetail("libcurl %s not compiled with support for HTTP/2.",
+							version->version);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+otel_CheckProtocol(int *next, void **extra, GucSource source)
+{
+	curl_version_info_data *version = curl_version_info(CURLVERSION_NOW);
+
+	/* gRPC is always HTTP/2 */
+	if (*next == PG_OTEL_CONFIG_PROTOCOL_GRPC &&
+		!(version->features & CURL_VERSION_HTTP2))
+	{
+		GUC_check_errdetail("libcurl %s not compiled with support for HTTP/2.",
+							version->version);
+		return false;
+	}
+
+	return true;
+}
+
 static bool
 otel_CheckExports(char **next, void **extra, GucSource source)
 {
@@ -320,6 +397,9 @@ otel_CheckExports(char **next, void **extra, GucSource source)
 		if (pg_strcasecmp(item, "logs") == 0 ||
 			pg_strcasecmp(item, "log") == 0)
 			parsed.signals |= PG_OTEL_CONFIG_LOGS;
+		else if (pg_strcasecmp(item, "metrics") == 0 ||
+				 pg_strcasecmp(item, "metric") == 0)
+			parsed.signals |= PG_OTEL_CONFIG_METRICS;
 		else
 		{
 			GUC_check_errdetail("Unrecognized signal: \"%s\".", item);
@@ -348,6 +428,258 @@ otel_AssignExports(const char *next, void *extra)
 	config.exports.signals = parsed->signals;
 }
 
+static bool
+otel_CheckRateLimit(char **next, void **extra, GucSource source)
+{
+	static const char *const severities[PG_OTEL_LIMIT_BUCKETS] = {
+		[PG_OTEL_LIMIT_DEBUG] = "debug",
+		[PG_OTEL_LIMIT_INFO] = "info",
+		[PG_OTEL_LIMIT_WARNING] = "warning",
+		[PG_OTEL_LIMIT_ERROR] = "error",
+		[PG_OTEL_LIMIT_FATAL] = "fatal",
+	};
+	struct otelRateLimit parsed = {};
+	int  rates[PG_OTEL_LIMIT_BUCKETS];
+	int  every = 0;
+	bool limited = false;
+	char *text;
+
+	ListCell *cell = NULL;
+	List     *list = NULL;
+
+	for (int i = 0; i < PG_OTEL_LIMIT_BUCKETS; i++)
+		rates[i] = -1;
+
+	text = guc_strdup(ERROR, *next);
+	if (!SplitIdentifierString(text, ',', &list))
+	{
+		GUC_check_errdetail("List syntax is invalid.");
+		guc_free(text);
+		list_free(list);
+		return false;
+	}
+
+	/* A bare number is the rate of every severity not named in the list */
+	foreach(cell, list)
+	{
+		char *item = (char *) lfirst(cell);
+		char *value = strchr(item, ':');
+		char *end = NULL;
+		int   bucket = -1;
+		long  rate;
+
+		if (value != NULL)
+		{
+			*value++ = '\0';
+
+			for (int i = 0; i < PG_OTEL_LIMIT_BUCKETS; i++)
+				if (pg_strcasecmp(item, severities[i]) == 0)
+					bucket = i;
+
+			if (bucket < 0)
+			{
+				GUC_check_errdetail("Unrecognized severity: \"%s\".", item);
+				guc_free(text);
+				list_free(list);
+				return false;
+			}
+		}
+		else
+			value = item;
+
+		errno = 0;
+		rate = strtol(value, &end, 10);
+
+		if (end == value || *end != '\0' || errno != 0 ||
+			rate < 0 || rate > 1000 * 1000)
+		{
+			GUC_check_errdetail("Rate must be an integer from 0 to 1000000: \"%s\".",
+								value);
+			guc_free(text);
+			list_free(list);
+			return false;
+		}
+
+		if (bucket < 0)
+			every = rate;
+		else
+			rates[bucket] = rate;
+	}
+
+	for (int i = 0; i < PG_OTEL_LIMIT_BUCKETS; i++)
+	{
+		parsed.perSecond[i] = (rates[i] >= 0) ? rates[i] : every;
+		limited = limited || parsed.perSecond[i] > 0;
+	}
+
+	guc_free(text);
+	list_free(list);
+
+	/* Nothing is limited when every rate is zero */
+	*extra = NULL;
+	if (!limited)
+		return true;
+
+	/* This will be freed by PostgreSQL GUC */
+	*extra = guc_malloc(ERROR, sizeof(parsed));
+	memcpy(*extra, &parsed, sizeof(parsed));
+	return true;
+}
+
+static void
+otel_AssignRateLimit(const char *next, void *extra)
+{
+	config.logs.rateLimit = (struct otelRateLimit *) extra;
+}
+
+/* Whether or not ch can be part of an SQLSTATE */
+static bool
+otel_IsSQLStateChar(char ch)
+{
+	return (ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'Z');
+}
+
+static bool
+otel_CheckSQLStateFilter(char **next, void **extra, GucSource source)
+{
+	struct otelSQLStateFilter *parsed;
+	int *codes;
+	char *text;
+
+	ListCell *cell = NULL;
+	List     *list = NULL;
+
+	text = guc_strdup(ERROR, *next);
+	if (!SplitIdentifierString(text, ',', &list))
+	{
+		GUC_check_errdetail("List syntax is invalid.");
+		guc_free(text);
+		list_free(list);
+		return false;
+	}
+
+	/* An empty list exports everything */
+	if (list == NIL)
+	{
+		guc_free(text);
+		*extra = NULL;
+		return true;
+	}
+
+	/*
+	 * Allocate enough for every item to be a code. Identifiers are downcased,
+	 * so compare them in upper case. This will be freed by PostgreSQL GUC.
+	 */
+	*extra = parsed = guc_malloc(ERROR, offsetof(struct otelSQLStateFilter, codes) +
+								 sizeof(int) * list_length(list));
+	MemSet(parsed, 0, offsetof(struct otelSQLStateFilter, codes));
+	codes = palloc(sizeof(int) * list_length(list));
+
+	foreach(cell, list)
+	{
+		char *item = (char *) lfirst(cell);
+		bool exclude = (item[0] == '-');
+		size_t length;
+
+		if (exclude)
+			item++;
+
+		length = strlen(item);
+		for (size_t i = 0; i < length; i++)
+			item[i] = pg_toupper((unsigned char) item[i]);
+
+		for (size_t i = 0; i < length; i++)
+			if (!otel_IsSQLStateChar(item[i]))
+				length = 0;
+
+		if (length == 2)
+		{
+			int category = ERRCODE_TO_CATEGORY(MAKE_SQLSTATE(item[0], item[1], '0', '0', '0'));
+			uint8 *bitmap = exclude ? parsed->excludeClasses : parsed->includeClasses;
+
+			bitmap[category / 8] |= 1 << (category % 8);
+		}
+		else if (length == 5)
+		{
+			int code = MAKE_SQLSTATE(item[0], item[1], item[2], item[3], item[4]);
+
+			/* Excluded codes go in front; included codes go behind */
+			if (exclude)
+				parsed->codes[parsed->excludeCodesLength++] = code;
+			else
+				codes[parsed->includeCodesLength++] = code;
+		}
+		else
+		{
+			GUC_check_errdetail("Unrecognized SQLSTATE or class: \"%s\".",
+								(char *) lfirst(cell));
+			guc_free(text);
+			guc_free(parsed);
+			*extra = NULL;
+			list_free(list);
+			pfree(codes);
+			return false;
+		}
+
+		if (!exclude)
+			parsed->include = true;
+	}
+
+	memcpy(parsed->codes + parsed->excludeCodesLength, codes,
+		   sizeof(int) * parsed->includeCodesLength);
+
+	guc_free(text);
+	list_free(list);
+	pfree(codes);
+	return true;
+}
+
+static void
+otel_AssignSQLStateFilter(const char *next, void *extra)
+{
+	config.logs.sqlstates = (struct otelSQLStateFilter *) extra;
+}
+
+/*
+ * Called by backends before any other work on a log message. Returns false
+ * when the message is below otel.logs_min_level or otel.logs_sqlstate_filter
+ * excludes it. Excluded SQLSTATEs take precedence over included ones.
+ */
+static bool
+otel_WantLogMessage(const struct otelConfiguration *config,
+					int elevel, int sqlerrcode)
+{
+	const struct otelSQLStateFilter *filter = config->logs.sqlstates;
+	int category;
+
+	if (elevel < config->logs.minLevel)
+		return false;
+
+	if (filter == NULL)
+		return true;
+
+	category = ERRCODE_TO_CATEGORY(sqlerrcode);
+
+	if (filter->excludeClasses[category / 8] & (1 << (category % 8)))
+		return false;
+
+	for (int i = 0; i < filter->excludeCodesLength; i++)
+		if (filter->codes[i] == sqlerrcode)
+			return false;
+
+	if (!filter->include)
+		return true;
+
+	if (filter->includeClasses[category / 8] & (1 << (category % 8)))
+		return true;
+
+	for (int i = 0; i < filter->includeCodesLength; i++)
+		if (filter->codes[filter->excludeCodesLength + i] == sqlerrcode)
+			return true;
+
+	return false;
+}
+
 static bool
 otel_CheckServiceName(char **next, void **extra, GucSource source)
 {
@@ -380,20 +712,74 @@ otel_DefineCustomVariables()
 {
 	DefineCustomIntVariable
 		("otel.attribute_count_limit",
-		 "Maximum attributes allowed on each signal",
-		 NULL,
+		 "Maximum attributes allowed on each log record",
+
+		 "Attributes beyond this are dropped and counted in"
+		 " dropped_attributes_count. Resource attributes are exempt.",
 
 		 &config.attributeCountLimit,
-		 PG_OTEL_RESOURCE_MAX_ATTRIBUTES,
-		 PG_OTEL_RESOURCE_MAX_ATTRIBUTES,
-		 PG_OTEL_RESOURCE_MAX_ATTRIBUTES,
+		 128, 0, INT_MAX,
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.attribute_value_length_limit",
+		 "Maximum characters in each log record attribute value",
+
+		 "Longer values are cut short before they leave the backend."
+		 " Resource attributes are exempt. -1 means no limit.",
+
+		 &config.attributeValueLengthLimit,
+		 -1, -1, MaxAllocSize / MAX_MULTIBYTE_CHAR_LEN,
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.blrp_export_timeout",
+		 "Maximum time the exporter spends on each batch of logs",
+		 NULL,
+
+		 &config.blrp.exportTimeoutMS,
+		 30 * 1000L, 1, 60 * 60 * 1000L, /* 30sec; between 1ms and 60min */
+
+		 PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.blrp_max_export_batch_size",
+		 "Maximum log records in each batch export",
+
+		 "Cannot be more than otel.blrp_max_queue_size.",
+
+		 &config.blrp.maxExportBatchSize,
+		 512, 1, 1024 * 1024,
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.blrp_max_queue_size",
+		 "Maximum log records waiting to be exported",
+
+		 "Log records beyond this are dropped.",
+
+		 &config.blrp.maxQueueSize,
+		 2048, 1, 1024 * 1024,
 
-		 PGC_INTERNAL, 0, NULL, NULL, NULL);
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.blrp_schedule_delay",
+		 "Maximum time a log record waits for its batch to fill",
+		 NULL,
+
+		 &config.blrp.scheduleDelayMS,
+		 1000, 0, 60 * 60 * 1000L, /* 1sec; between 0 and 60min */
+
+		 PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
 
 	DefineCustomStringVariable
 		("otel.export",
 		 "Signals to export over OTLP",
-		 "May be empty or \"logs\".",
+		 "May be empty, \"logs\", \"metrics\", or both.",
 
 		 &config.exports.text,
 		 "",
@@ -401,6 +787,192 @@ otel_DefineCustomVariables()
 		 PGC_SIGHUP, GUC_LIST_INPUT,
 		 otel_CheckExports, otel_AssignExports, NULL);
 
+	DefineCustomBoolVariable
+		("otel.exporter_pipeline",
+		 "Whether exporters send batches from a separate thread",
+
+		 "The thread compresses and sends requests while the exporter"
+		 " reads from backends and builds the next batch.",
+
+		 &config.exporterPipeline,
+		 false,
+
+		 PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.exporter_workers",
+		 "Number of background workers that export telemetry",
+
+		 "Each backend sends to one of them, chosen by its process ID."
+		 " Every worker has its own otel.ipc_buffer_size.",
+
+		 &config.exporterWorkers,
+		 1, 1, PG_OTEL_EXPORTER_WORKERS_MAX,
+
+		 PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.ipc_buffer_size",
+		 "Size of the shared memory buffer for telemetry data",
+
+		 "Only used when otel.ipc_method is \"shared_memory\".",
+
+		 &config.ipc.bufferSizeKB,
+		 1024, 64, 1024 * 1024, /* 1MB; between 64kB and 1GB */
+
+		 PGC_POSTMASTER, GUC_UNIT_KB, NULL, NULL, NULL);
+
+	DefineCustomEnumVariable
+		("otel.ipc_method",
+		 "How backends send telemetry data to the exporter",
+
+		 "Backends write to a shared memory buffer or to a pipe."
+		 " Postmaster always writes to the pipe.",
+
+		 &config.ipc.method,
+		 PG_OTEL_CONFIG_IPC_SHARED_MEMORY,
+		 otel_IPCMethodOptions,
+
+		 PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.logs_dedup_interval",
+		 "Time during which repeated log records are collapsed",
+
+		 "Log records with the same body, severity, SQLSTATE, and code location"
+		 " are exported once, then once more with a count of the repeats."
+		 " Zero disables this.",
+
+		 &config.logs.dedupIntervalMS,
+		 0, 0, 60 * 60 * 1000L, /* between 0 and 60min */
+
+		 PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+
+	DefineCustomEnumVariable
+		("otel.logs_min_level",
+		 "Minimum severity of log records to export",
+
+		 "Log records below this are skipped before any other work."
+		 " This can be set for each role and database.",
+
+		 &config.logs.minLevel,
+		 DEBUG5,
+		 otel_LogLevelOptions,
+
+		 PGC_SUSET, 0, NULL, NULL, NULL);
+
+	DefineCustomStringVariable
+		("otel.logs_rate_limit",
+		 "Maximum log records per second at each severity",
+
+		 "A number for every severity, and items like \"error:100\" for"
+		 " one of debug, info, warning, error, or fatal. Log records beyond"
+		 " this are suppressed and counted in a summary record. Zero"
+		 " disables this.",
+
+		 &config.logs.rateLimitText,
+		 "0",
+
+		 PGC_SIGHUP, GUC_LIST_INPUT,
+		 otel_CheckRateLimit, otel_AssignRateLimit, NULL);
+
+	DefineCustomRealVariable
+		("otel.logs_sample_ratio",
+		 "Fraction of log records below WARNING to export",
+
+		 "Log records are chosen at random. The rest are suppressed and"
+		 " counted in a summary record.",
+
+		 &config.logs.sampleRatio,
+		 1.0, 0.0, 1.0,
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomStringVariable
+		("otel.logs_sqlstate_filter",
+		 "SQLSTATE codes and classes of log records to export",
+
+		 "A list of five-character codes and two-character classes."
+		 " Those that begin with \"-\" are skipped. When any do not, only"
+		 " log records that match one of those are exported.",
+
+		 &config.logs.sqlstatesText,
+		 "",
+
+		 PGC_SUSET, GUC_LIST_INPUT,
+		 otel_CheckSQLStateFilter, otel_AssignSQLStateFilter, NULL);
+
+	DefineCustomEnumVariable
+		("otel.logs_statement_dedup",
+		 "How log records share the text of repeated statements",
+
+		 "With \"omit\" or \"reattach\", backends send the text of each"
+		 " statement to the exporter once per otel.logs_statement_dedup_interval."
+		 " Then \"omit\" exports it once and \"reattach\" exports it on every"
+		 " log record. Requires compute_query_id.",
+
+		 &config.logs.statementDedup,
+		 PG_OTEL_CONFIG_STATEMENT_DEDUP_OFF,
+		 otel_StatementDedupOptions,
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.logs_statement_dedup_interval",
+		 "Time between sends of the same statement text",
+
+		 "Only used when otel.logs_statement_dedup is not \"off\".",
+
+		 &config.logs.statementDedupIntervalMS,
+		 60 * 1000, 1, 60 * 60 * 1000L, /* 1min; between 1ms and 60min */
+
+		 PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.metric_export_interval",
+		 "Time between exports of metrics about the exporter",
+
+		 "Only used when otel.export includes \"metrics\".",
+
+		 &config.metricExportIntervalMS,
+		 60 * 1000, 1000, 24 * 60 * 60 * 1000, /* 1min; between 1s and 24h */
+
+		 PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+
+	DefineCustomEnumVariable
+		("otel.otlp_compression",
+		 "How the exporter compresses each batch export",
+		 NULL,
+
+		 &config.otlp.compression,
+		 PG_OTEL_CONFIG_COMPRESSION_NONE,
+		 otel_CompressionOptions,
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.otlp_compression_level",
+		 "Compression level of the exporter",
+
+		 "Only used when otel.otlp_compression is \"gzip\"."
+		 " Lower is faster; higher is smaller.",
+
+		 &config.otlp.compressionLevel,
+		 6, 1, 9, /* same as Z_DEFAULT_COMPRESSION */
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.otlp_concurrent_exports",
+		 "Maximum batch exports the exporter sends at the same time",
+
+		 "The exporter keeps receiving telemetry while these are in flight.",
+
+		 &config.otlp.concurrentExports,
+		 1, 1, 100,
+
+		 PGC_SIGHUP, 0, NULL, NULL, NULL);
+
 	DefineCustomStringVariable
 		("otel.otlp_endpoint",
 		 "Target URL to which the exporter sends signals",
@@ -413,15 +985,42 @@ otel_DefineCustomVariables()
 
 		 PGC_SIGHUP, 0, otel_CheckEndpoint, NULL, NULL);
 
-	DefineCustomStringVariable
+	DefineCustomBoolVariable
+		("otel.otlp_http2",
+		 "Whether the exporter sends batches over HTTP/2",
+
+		 "Concurrent exports share one connection."
+		 " HTTP/2 is negotiated for https and assumed for http.",
+
+		 &config.otlp.http2,
+		 false,
+
+		 PGC_SIGHUP, 0, otel_CheckHTTP2, NULL, NULL);
+
+	DefineCustomIntVariable
+		("otel.otlp_max_request_size",
+		 "Maximum size of each batch export before compression",
+
+		 "Batches are closed and split to stay below this size."
+		 " Log records larger than this are dropped.",
+
+		 &config.otlp.maxRequestSizeKB,
+		 4096, 16, 1024 * 1024, /* 4MB; between 16kB and 1GB */
+
+		 PGC_SIGHUP, GUC_UNIT_KB, NULL, NULL, NULL);
+
+	DefineCustomEnumVariable
 		("otel.otlp_protocol",
 		 "The exporter transport protocol",
-		 NULL,
+
+		 "With \"grpc\", the path of otel.otlp_endpoint is ignored and the"
+		 " collector usually listens on port 4317.",
 
 		 &config.otlp.protocol,
-		 "http/protobuf",
+		 PG_OTEL_CONFIG_PROTOCOL_HTTP_PROTOBUF,
+		 otel_ProtocolOptions,
 
-		 PGC_INTERNAL, 0, NULL, NULL, NULL);
+		 PGC_SIGHUP, 0, otel_CheckProtocol, NULL, NULL);
 
 	DefineCustomIntVariable
 		("otel.otlp_timeout",
@@ -455,6 +1054,19 @@ otel_DefineCustomVariables()
 
 		 PGC_SIGHUP, 0, otel_CheckServiceName, NULL, NULL);
 
+	DefineCustomIntVariable
+		("otel.spill_max_size",
+		 "Maximum disk space for batches that could not be sent",
+
+		 "Batches are saved in the \"pg_otel\" directory while the collector is"
+		 " unavailable and sent once it returns. Batches that do not fit are"
+		 " dropped. Zero disables this.",
+
+		 &config.spillMaxSizeKB,
+		 0, 0, 1024 * 1024 * 1024, /* between 0 and 1TB */
+
+		 PGC_SIGHUP, GUC_UNIT_KB, NULL, NULL, NULL);
+
 #if PG_VERSION_NUM >= 150000
 	MarkGUCPrefixReserved("otel");
 #else
@@ -469,10 +1081,25 @@ otel_ReadEnvironment(void)
 	 * https://docs.opentelemetry.io/reference/specification/sdk-environment-variables/#attribute-limits
 	 */
 	otel_CustomVariableEnv("otel.attribute_count_limit", "OTEL_ATTRIBUTE_COUNT_LIMIT");
+	otel_CustomVariableEnv("otel.attribute_value_length_limit", "OTEL_ATTRIBUTE_VALUE_LENGTH_LIMIT");
+
+	/*
+	 * https://docs.opentelemetry.io/reference/specification/sdk-environment-variables/#batch-logrecord-processor
+	 */
+	otel_CustomVariableEnv("otel.blrp_export_timeout", "OTEL_BLRP_EXPORT_TIMEOUT");
+	otel_CustomVariableEnv("otel.blrp_max_export_batch_size", "OTEL_BLRP_MAX_EXPORT_BATCH_SIZE");
+	otel_CustomVariableEnv("otel.blrp_max_queue_size", "OTEL_BLRP_MAX_QUEUE_SIZE");
+	otel_CustomVariableEnv("otel.blrp_schedule_delay", "OTEL_BLRP_SCHEDULE_DELAY");
+
+	/*
+	 * https://docs.opentelemetry.io/reference/specification/sdk-environment-variables/#periodic-exporting-metricreader
+	 */
+	otel_CustomVariableEnv("otel.metric_export_interval", "OTEL_METRIC_EXPORT_INTERVAL");
 
 	/*
 	 * https://docs.opentelemetry.io/reference/specification/protocol/exporter/
 	 */
+	otel_CustomVariableEnv("otel.otlp_compression", "OTEL_EXPORTER_OTLP_COMPRESSION");
 	otel_CustomVariableEnv("otel.otlp_endpoint", "OTEL_EXPORTER_OTLP_ENDPOINT");
 	otel_CustomVariableEnv("otel.otlp_protocol", "OTEL_EXPORTER_OTLP_PROTOCOL");
 	otel_CustomVariableEnv("otel.otlp_timeout", "OTEL_EXPORTER_OTLP_TIMEOUT");
@@ -7,14 +7,87 @@
 #define PG_OTEL_CONFIG_METRICS 0x02
 #define PG_OTEL_CONFIG_TRACES  0x04
 
-#define PG_OTEL_LOG_RECORD_MAX_ATTRIBUTES 20
+#define PG_OTEL_CONFIG_IPC_PIPE          0
+#define PG_OTEL_CONFIG_IPC_SHARED_MEMORY 1
+
+#define PG_OTEL_CONFIG_COMPRESSION_NONE 0
+#define PG_OTEL_CONFIG_COMPRESSION_GZIP 1
+
+#define PG_OTEL_CONFIG_PROTOCOL_HTTP_PROTOBUF 0
+#define PG_OTEL_CONFIG_PROTOCOL_GRPC          1
+
+#define PG_OTEL_CONFIG_STATEMENT_DEDUP_OFF      0
+#define PG_OTEL_CONFIG_STATEMENT_DEDUP_OMIT     1
+#define PG_OTEL_CONFIG_STATEMENT_DEDUP_REATTACH 2
+
 #define PG_OTEL_RESOURCE_MAX_ATTRIBUTES 128
 
+/* Each exporter takes one of max_worker_processes */
+#define PG_OTEL_EXPORTER_WORKERS_MAX 64
+
+/* Log records are limited separately at each of these severities */
+#define PG_OTEL_LIMIT_DEBUG   0
+#define PG_OTEL_LIMIT_INFO    1
+#define PG_OTEL_LIMIT_WARNING 2
+#define PG_OTEL_LIMIT_ERROR   3
+#define PG_OTEL_LIMIT_FATAL   4
+#define PG_OTEL_LIMIT_BUCKETS 5
+
+/* There is one bit for every SQLSTATE class; see ERRCODE_TO_CATEGORY */
+#define PG_OTEL_SQLSTATE_CLASSES (1 << 12)
+
+struct otelBatchConfiguration
+{
+	int exportTimeoutMS;
+	int maxExportBatchSize;
+	int maxQueueSize;
+	int scheduleDelayMS;
+};
 struct otelBaggageConfiguration
 {
 	char *parsed;
 	char *text;
 };
+struct otelIPCConfiguration
+{
+	int bufferSizeKB;
+	int method;
+};
+/*
+ * otelSQLStateFilter is otel.logs_sqlstate_filter parsed into bitmaps of
+ * classes and a short list of codes. Classes and codes are packed the same
+ * way as ErrorData.sqlerrcode.
+ */
+struct otelSQLStateFilter
+{
+	bool  include; /* only matching records are exported */
+	uint8 excludeClasses[PG_OTEL_SQLSTATE_CLASSES / 8];
+	uint8 includeClasses[PG_OTEL_SQLSTATE_CLASSES / 8];
+
+	int excludeCodesLength;
+	int includeCodesLength;
+	int codes[FLEXIBLE_ARRAY_MEMBER]; /* excluded then included */
+};
+/*
+ * otelRateLimit is otel.logs_rate_limit parsed into log records per second at
+ * each severity, indexed by PG_OTEL_LIMIT_*. Zero does not limit a severity.
+ */
+struct otelRateLimit
+{
+	int perSecond[PG_OTEL_LIMIT_BUCKETS];
+};
+struct otelLogsConfiguration
+{
+	int dedupIntervalMS;
+	int minLevel;
+	struct otelRateLimit *rateLimit; /* NULL when nothing is limited */
+	char *rateLimitText;
+	double sampleRatio;
+	struct otelSQLStateFilter *sqlstates;
+	char *sqlstatesText;
+	int statementDedup;
+	int statementDedupIntervalMS;
+};
 struct otelSignalConfiguration
 {
 	int signals;
@@ -22,19 +95,31 @@ struct otelSignalConfiguration
 };
 struct otlpConfiguration
 {
+	int compression;
+	int compressionLevel;
+	int concurrentExports;
 	char *endpoint;
-	char *protocol;
+	bool http2;
+	int maxRequestSizeKB;
+	int protocol;
 	int timeoutMS;
 };
 struct otelConfiguration
 {
 	int attributeCountLimit;
 	int attributeValueLengthLimit;
+	struct otelBatchConfiguration blrp;
 	struct otelSignalConfiguration exports;
+	bool exporterPipeline;
+	int exporterWorkers;
+	struct otelIPCConfiguration ipc;
+	struct otelLogsConfiguration logs;
+	int metricExportIntervalMS;
 	struct otlpConfiguration otlp;
 	struct otlpConfiguration otlpLogs;
 	struct otelBaggageConfiguration resourceAttributes;
 	char *serviceName;
+	int spillMaxSizeKB;
 };
 
 static struct otelConfiguration config;
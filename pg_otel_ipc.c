@@ -1,14 +1,21 @@
 /* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
 
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
 #include <unistd.h>
 
 #include "postgres.h"
 #include "miscadmin.h"
 #include "lib/stringinfo.h"
 #include "postmaster/syslogger.h"
+#include "storage/ipc.h"
+#include "storage/shmem.h"
 #include "utils/elog.h"
 
+#include "pg_otel.h"
 #include "pg_otel_ipc.h"
+#include "pg_otel_wait.h"
 
 static uint32
 otel_AddReadEventToSet(struct otelIPC *ipc, WaitEventSet *set)
@@ -24,6 +31,53 @@ otel_AddReadEventToSet(struct otelIPC *ipc, WaitEventSet *set)
 	return 0;
 }
 
+/*
+ * Find or create the shared memory of ipc, including a ring with capacity
+ * bytes of space when capacity is not zero. Each channel has its own. The
+ * caller should hold AddinShmemInitLock.
+ */
+static void
+otel_AttachSharedMemory(struct otelIPC *ipc, Size capacity, int channel)
+{
+	struct otelIPCStats *stats;
+	struct otelRing *ring;
+	char name[SHMEM_INDEX_KEYSIZE];
+	bool found;
+
+	Assert(ipc != NULL);
+	Assert(capacity % PG_OTEL_RING_ALIGN == 0);
+	StaticAssertStmt(sizeof(struct otelRingEntry) <= PG_OTEL_RING_ALIGN,
+					 "ring entry header must fit in its alignment");
+
+	snprintf(name, sizeof(name), PG_OTEL_LIBRARY " ipc %d", channel);
+	stats = ShmemInitStruct(name, sizeof(*stats), &found);
+
+	if (!found)
+	{
+		pg_atomic_init_u64(&stats->bytes, 0);
+		pg_atomic_init_u64(&stats->dropped, 0);
+	}
+
+	ipc->stats = stats;
+
+	if (capacity == 0)
+		return;
+
+	snprintf(name, sizeof(name), PG_OTEL_LIBRARY " ring %d", channel);
+	ring = ShmemInitStruct(name, otel_RingSize(capacity), &found);
+
+	if (!found)
+	{
+		pg_atomic_init_u64(&ring->head, 0);
+		pg_atomic_init_u64(&ring->tail, 0);
+		ring->latch = NULL;
+		ring->size = capacity;
+		MemSet(ring->data, 0, capacity);
+	}
+
+	ipc->ring = ring;
+}
+
 static void
 otel_CloseWrite(struct otelIPC *ipc)
 {
@@ -36,6 +90,57 @@ otel_CloseWrite(struct otelIPC *ipc)
 #endif
 }
 
+static void
+otel_DetachSharedMemory(struct otelIPC *ipc)
+{
+	Assert(ipc != NULL);
+
+	ipc->ring = NULL;
+	ipc->stats = NULL;
+}
+
+/*
+ * The number of bytes sent by every process attached to shared memory. This
+ * does not include bytes sent by postmaster.
+ */
+static uint64
+otel_IPCBytes(struct otelIPC *ipc)
+{
+	Assert(ipc != NULL);
+
+	if (ipc->stats == NULL)
+		return 0;
+
+	return pg_atomic_read_u64(&ipc->stats->bytes);
+}
+
+/*
+ * The number of messages dropped by every process attached to shared memory.
+ * This does not include messages dropped by postmaster.
+ */
+static uint64
+otel_IPCDropped(struct otelIPC *ipc)
+{
+	Assert(ipc != NULL);
+
+	if (ipc->stats == NULL)
+		return 0;
+
+	return pg_atomic_read_u64(&ipc->stats->dropped);
+}
+
+/* The amount of shared memory needed for a ring of capacity bytes, if any */
+static Size
+otel_IPCSharedMemorySize(Size capacity)
+{
+	Size size = MAXALIGN(sizeof(struct otelIPCStats));
+
+	if (capacity > 0)
+		size = add_size(size, otel_RingSize(capacity));
+
+	return size;
+}
+
 static void
 otel_OpenIPC(struct otelIPC *ipc)
 {
@@ -46,53 +151,377 @@ otel_OpenIPC(struct otelIPC *ipc)
 		ereport(FATAL,
 				(errcode_for_socket_access(),
 				 errmsg("could not create pipe: %m")));
+
+	/*
+	 * Writers should never wait for the reader. Each chunk is smaller than
+	 * PIPE_BUF, so each write either succeeds entirely or not at all.
+	 */
+	if (fcntl(ipc->pipe[1], F_SETFL, O_NONBLOCK) < 0)
+		ereport(FATAL,
+				(errcode_for_socket_access(),
+				 errmsg("could not set pipe to nonblocking mode: %m")));
 #endif
 }
 
+/* The amount of shared memory needed for a ring of capacity bytes */
+static Size
+otel_RingSize(Size capacity)
+{
+	return add_size(offsetof(struct otelRing, data), capacity);
+}
+
 /*
- * Write message to ipc in atomic chunks.
+ * Set the latch to be woken when a message is written to the ring, if any.
  */
 static void
-otel_SendOverIPC(struct otelIPC *ipc, bits8 signal, uint8_t *message, size_t size)
+otel_SetRingLatch(struct otelIPC *ipc, Latch *latch)
 {
-	PipeProtoChunk chunk;
-	int rc;
-
 	Assert(ipc != NULL);
+
+	if (ipc->ring != NULL)
+		ipc->ring->latch = latch;
+}
+
+/*
+ * Copy message into ring and wake its reader. Returns false when the ring
+ * does not have room for the message.
+ */
+static bool
+otel_SendOverRing(struct otelRing *ring, bits8 signal,
+				  const uint8_t *message, size_t size)
+{
+	struct otelRingEntry *entry;
+	uint64 head, tail, offset, needed, skipped;
+	Latch *latch;
+
+	Assert(ring != NULL);
 	Assert(message != NULL);
-	Assert(size > 0);
 
-	chunk.proto.nuls[0] = chunk.proto.nuls[1] = '\0';
-	chunk.proto.pid = MyProcPid;
-#if PG_VERSION_NUM >= 150000
-	chunk.proto.flags = signal;
-#else
-	chunk.proto.is_last = signal;
-#endif
+	/* The header and message are contiguous and aligned */
+	needed = TYPEALIGN64(PG_OTEL_RING_ALIGN, PG_OTEL_RING_ALIGN + size);
+	if (needed > ring->size)
+		return false;
+
+	for (;;)
+	{
+		/*
+		 * Read tail before head so the difference between them is never less
+		 * than the space that is actually in use.
+		 */
+		tail = pg_atomic_read_u64(&ring->tail);
+		pg_read_barrier();
+		head = pg_atomic_read_u64(&ring->head);
+
+		/* Skip the end of the ring when the message does not fit there */
+		offset = head % ring->size;
+		skipped = (ring->size - offset < needed) ? ring->size - offset : 0;
+
+		if (head + skipped + needed - tail > ring->size)
+			return false;
+
+		if (pg_atomic_compare_exchange_u64(&ring->head, &head,
+										   head + skipped + needed))
+			break;
+	}
 
-	/* Write all but the last chunk */
-	while (size > PIPE_MAX_PAYLOAD)
+	if (skipped > 0)
 	{
-		chunk.proto.len = PIPE_MAX_PAYLOAD;
-		memcpy(chunk.proto.data, message, PIPE_MAX_PAYLOAD);
+		entry = (struct otelRingEntry *) (ring->data + offset);
+		entry->state = PG_OTEL_RING_SKIP;
+		offset = 0;
+	}
+
+	entry = (struct otelRingEntry *) (ring->data + offset);
+	entry->signal = signal;
+	entry->size = size;
+	memcpy(ring->data + offset + PG_OTEL_RING_ALIGN, message, size);
+
+	/* Publish the message only after it is entirely written */
+	pg_write_barrier();
+	entry->state = PG_OTEL_RING_READY;
+
+	latch = ring->latch;
+	if (latch != NULL)
+		SetLatch(latch);
+
+	return true;
+}
+
+/*
+ * Write all of buffer to the pipe of ipc, or nothing at all. The pipe does not
+ * block, but the write can still take a while when the worker is busy.
+ */
+static bool
+otel_WritePipe(struct otelIPC *ipc, const char *buffer, size_t size)
+{
+	Assert(size <= PIPE_BUF);
+
 #ifndef WIN32
-		rc = write(ipc->pipe[1], &chunk, PIPE_HEADER_SIZE + PIPE_MAX_PAYLOAD);
-		(void) rc;
+	for (;;)
+	{
+		ssize_t rc;
+
+		pgstat_report_wait_start(otel_WaitEvents.ipcSend);
+		rc = write(ipc->pipe[1], buffer, size);
+		pgstat_report_wait_end();
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		return rc == (ssize_t) size;
+	}
 #endif
-		message += PIPE_MAX_PAYLOAD;
-		size -= PIPE_MAX_PAYLOAD;
+
+	return false;
+}
+
+/*
+ * Write message to ipc in atomic chunks, as many chunks per write as fit in
+ * PIPE_BUF. Returns false when the pipe is full, in which case some of the
+ * message may have been written. The reader discards that portion when the
+ * next message from this process begins.
+ */
+static bool
+otel_SendOverPipe(struct otelIPC *ipc, bits8 signal, const uint8_t *message, size_t size)
+{
+	char   buffer[PIPE_BUF];
+	size_t buffered = 0;
+	bits8  flags = signal | PG_OTEL_IPC_STARTED;
+	int    save_errno = errno;
+	bool   written = true;
+
+	Assert(ipc != NULL);
+	Assert(message != NULL);
+	Assert(size > 0);
+	StaticAssertStmt(PIPE_BUF >= PIPE_CHUNK_SIZE,
+					 "pipe chunks must be written atomically");
+
+	while (written && size > 0)
+	{
+		PipeProtoHeader header;
+
+		if (size <= PIPE_MAX_PAYLOAD)
+			flags |= PG_OTEL_IPC_FINISHED;
+
+		header.nuls[0] = header.nuls[1] = '\0';
+		header.len = Min(size, PIPE_MAX_PAYLOAD);
+		header.pid = MyProcPid;
+		PG_OTEL_IPC_FLAGS(header) = flags;
+
+		memcpy(buffer + buffered, &header, PIPE_HEADER_SIZE);
+		memcpy(buffer + buffered + PIPE_HEADER_SIZE, message, header.len);
+		buffered += PIPE_HEADER_SIZE + header.len;
+
+		flags &= ~PG_OTEL_IPC_STARTED;
+		message += header.len;
+		size -= header.len;
+
+		/* Write when the message is done or another chunk might not fit */
+		if (size == 0 || buffered + PIPE_CHUNK_SIZE > sizeof(buffer))
+		{
+			written = otel_WritePipe(ipc, buffer, buffered);
+			buffered = 0;
+		}
 	}
 
-	/* Write the last chunk */
-#if PG_VERSION_NUM >= 150000
-	chunk.proto.flags |= PG_OTEL_IPC_FINISHED;
-#else
-	chunk.proto.is_last |= PG_OTEL_IPC_FINISHED;
-#endif
-	chunk.proto.len = size;
-	memcpy(chunk.proto.data, message, size);
-	rc = write(ipc->pipe[1], &chunk, PIPE_HEADER_SIZE + size);
-	(void) rc;
+	errno = save_errno;
+	return written;
+}
+
+/*
+ * Send message containing count records to the background worker. Backends
+ * write to shared memory when it is available and has room. Postmaster never
+ * touches shared memory, so it always writes to the pipe.
+ *
+ * This never waits for the background worker. The records are dropped and
+ * counted when there is no room for them.
+ */
+static void
+otel_WriteOverIPC(struct otelIPC *ipc, bits8 signal,
+				  const uint8_t *message, size_t size, int count)
+{
+	Assert(ipc != NULL);
+
+	if ((ipc->ring != NULL && IsUnderPostmaster &&
+		 otel_SendOverRing(ipc->ring, signal, message, size)) ||
+		otel_SendOverPipe(ipc, signal, message, size))
+	{
+		if (ipc->stats != NULL && IsUnderPostmaster)
+			pg_atomic_fetch_add_u64(&ipc->stats->bytes, size);
+		return;
+	}
+
+	ipc->dropped += count;
+
+	if (ipc->stats != NULL && IsUnderPostmaster)
+		pg_atomic_fetch_add_u64(&ipc->stats->dropped, count);
+}
+
+/*
+ * Send all staged records to the background worker in one message.
+ */
+static void
+otel_FlushIPC(struct otelIPC *ipc)
+{
+	Assert(ipc != NULL);
+
+	if (ipc->stagedCount == 0)
+		return;
+
+	otel_WriteOverIPC(ipc, ipc->stagedSignal,
+					  ipc->staged, ipc->stagedSize, ipc->stagedCount);
+
+	ipc->stagedCount = 0;
+	ipc->stagedSize = 0;
+}
+
+/* Called before this process detaches from shared memory */
+static void
+otel_FlushIPCAtExit(int code, Datum arg)
+{
+	otel_FlushIPC((struct otelIPC *) DatumGetPointer(arg));
+}
+
+/*
+ * Reserve size bytes for one record in the staging buffer of ipc. The caller
+ * should fill them in before anything else is sent. Staged records are flushed
+ * sooner when there is no room for another. Returns NULL when the record would
+ * not fit even in an empty buffer.
+ */
+static uint8_t *
+otel_StageOverIPC(struct otelIPC *ipc, bits8 signal, size_t size)
+{
+	uint32 length = size;
+	uint8_t *record;
+
+	Assert(ipc != NULL);
+
+	if (ipc->stagedCount > 0 &&
+		(ipc->stagedSignal != signal ||
+		 ipc->stagedSize + sizeof(length) + size > sizeof(ipc->staged)))
+		otel_FlushIPC(ipc);
+
+	if (sizeof(length) + size > sizeof(ipc->staged))
+		return NULL;
+
+	/* Send anything staged by a backend before it exits */
+	if (!ipc->flushAtExit && IsUnderPostmaster)
+	{
+		before_shmem_exit(otel_FlushIPCAtExit, PointerGetDatum(ipc));
+		ipc->flushAtExit = true;
+	}
+
+	memcpy(ipc->staged + ipc->stagedSize, &length, sizeof(length));
+	record = ipc->staged + ipc->stagedSize + sizeof(length);
+
+	ipc->stagedSignal = signal;
+	ipc->stagedSize += sizeof(length) + size;
+	ipc->stagedCount++;
+
+	return record;
+}
+
+/*
+ * Allocate size bytes for one record that is too large to stage. The caller
+ * should fill them in and pass them to [otel_SendAllocatedOverIPC], which
+ * sends the record without copying it again.
+ */
+static uint8_t *
+otel_AllocateOverIPC(size_t size)
+{
+	uint32 length = size;
+	uint8_t *message = palloc(sizeof(length) + size);
+
+	memcpy(message, &length, sizeof(length));
+	return message + sizeof(length);
+}
+
+/*
+ * Send one record from [otel_AllocateOverIPC] to the background worker right
+ * away, by itself, and free it.
+ */
+static void
+otel_SendAllocatedOverIPC(struct otelIPC *ipc, bits8 signal, uint8_t *record)
+{
+	uint8_t *message = record - sizeof(uint32);
+	uint32 length;
+
+	Assert(ipc != NULL);
+	Assert(record != NULL);
+
+	memcpy(&length, message, sizeof(length));
+	otel_WriteOverIPC(ipc, signal, message, sizeof(length) + length, 1);
+	pfree(message);
+}
+
+/*
+ * Pass each record in message to dispatch. Each record is prefixed by its size.
+ */
+static void
+otel_DispatchRecords(void *opaque,
+					 void (*dispatch)(void *opaque, bits8 signal,
+									  const uint8_t *record, size_t size),
+					 bits8 signal, const uint8_t *message, size_t size)
+{
+	while (size > 0)
+	{
+		uint32 length;
+
+		if (size < sizeof(length))
+			break;
+
+		memcpy(&length, message, sizeof(length));
+		message += sizeof(length);
+		size -= sizeof(length);
+
+		if (length > size)
+			break;
+
+		dispatch(opaque, signal, message, length);
+		message += length;
+		size -= length;
+	}
+
+	if (size > 0)
+		ereport(WARNING, (errmsg("unexpected otel message length")));
+}
+
+/*
+ * Discard unfinished messages from processes that have exited. The rest of
+ * those messages is never coming. This calls kill() for every process that
+ * sent one, so it checks once per second at most.
+ */
+static void
+otel_DiscardOrphans(struct otelIPC *ipc)
+{
+	TimestampTz now;
+
+	if (ipc->unfinished == 0)
+		return;
+
+	now = GetCurrentTimestamp();
+	if (!TimestampDifferenceExceeds(ipc->orphansCheckedAt, now, 1000))
+		return;
+
+	ipc->orphansCheckedAt = now;
+
+	for (int i = 0; i < lengthof(ipc->buckets); i++)
+		for (int j = 0; j < lengthof(ipc->buckets[i]); j++)
+		{
+			ListCell *cell;
+
+			foreach(cell, ipc->buckets[i][j])
+			{
+				struct otelIPCPortion *slot = lfirst(cell);
+
+				if (slot->pid != 0 && kill(slot->pid, 0) < 0 && errno == ESRCH)
+				{
+					slot->pid = 0;
+					pfree(slot->data.data);
+					ipc->unfinished--;
+				}
+			}
+		}
 }
 
 static void
@@ -100,33 +529,24 @@ otel_ProcessInput(struct otelIPC *ipc, void *opaque,
 				  void (*dispatch)(void *opaque, bits8 signal,
 								   const uint8_t *message, size_t size))
 {
-	struct Portion
-	{
-		int32 pid;
-		StringInfoData data;
-	};
-
 	uint8_t *cursor = ipc->buffer;
 	int remaining = ipc->offset;
 
 	while (remaining >= (int) (PIPE_HEADER_SIZE + 1))
 	{
 		int   length;
-		bits8 signal;
+		bits8 flags, signal;
 		PipeProtoHeader header;
 		List     *portionBucket;
 		List    **portionBuckets;
 		ListCell *cell;
-		struct Portion *empty = NULL;
-		struct Portion *message = NULL;
+		struct otelIPCPortion *empty = NULL;
+		struct otelIPCPortion *message = NULL;
 
 		/* Verify the cursor points to a protocol header */
 		memcpy(&header, cursor, PIPE_HEADER_SIZE);
-#if PG_VERSION_NUM >= 150000
-		signal = header.flags & PG_OTEL_IPC_SIGNALS;
-#else
-		signal = header.is_last & PG_OTEL_IPC_SIGNALS;
-#endif
+		flags = PG_OTEL_IPC_FLAGS(header);
+		signal = flags & PG_OTEL_IPC_SIGNALS;
 		if (!(header.nuls[0] == '\0' && header.nuls[1] == '\0' &&
 			  header.len > 0 && header.len <= PIPE_MAX_PAYLOAD &&
 			  header.pid != 0 && (signal == PG_OTEL_IPC_LOGS ||
@@ -163,7 +583,7 @@ otel_ProcessInput(struct otelIPC *ipc, void *opaque,
 		portionBucket = portionBuckets[header.pid % 256];
 		foreach(cell, portionBucket)
 		{
-			struct Portion *slot = (struct Portion *) lfirst(cell);
+			struct otelIPCPortion *slot = (struct otelIPCPortion *) lfirst(cell);
 
 			if (slot->pid == header.pid)
 			{
@@ -174,14 +594,34 @@ otel_ProcessInput(struct otelIPC *ipc, void *opaque,
 				empty = slot;
 		}
 
-#if PG_VERSION_NUM >= 150000
-		if (message == NULL && (header.flags & PG_OTEL_IPC_FINISHED))
-#else
-		if (message == NULL && (header.is_last & PG_OTEL_IPC_FINISHED))
-#endif
+		/*
+		 * The writer gives up on a message when the pipe is full. Discard what
+		 * arrived of it when the next message from that process begins.
+		 */
+		if (message != NULL && (flags & PG_OTEL_IPC_STARTED))
+		{
+			message->pid = 0;
+			pfree(message->data.data);
+			ipc->unfinished--;
+
+			if (empty == NULL)
+				empty = message;
+			message = NULL;
+		}
+
+		/* Discard the remainder of a message whose beginning was not read */
+		if (message == NULL && !(flags & PG_OTEL_IPC_STARTED))
+		{
+			remaining -= length;
+			cursor += length;
+			continue;
+		}
+
+		if (message == NULL && (flags & PG_OTEL_IPC_FINISHED))
 		{
 			/* This chunk is a complete message; return it */
-			dispatch(opaque, signal, cursor + PIPE_HEADER_SIZE, header.len);
+			otel_DispatchRecords(opaque, dispatch, signal,
+								 cursor + PIPE_HEADER_SIZE, header.len);
 
 			/* On to the next chunk */
 			remaining -= length;
@@ -212,14 +652,11 @@ otel_ProcessInput(struct otelIPC *ipc, void *opaque,
 		appendBinaryStringInfo((StringInfo) &(message->data),
 							   (char *)cursor + PIPE_HEADER_SIZE, header.len);
 
-#if PG_VERSION_NUM >= 150000
-		if (header.flags & PG_OTEL_IPC_FINISHED)
-#else
-		if (header.is_last & PG_OTEL_IPC_FINISHED)
-#endif
+		if (flags & PG_OTEL_IPC_FINISHED)
 		{
 			/* The message is now complete; return it */
-			dispatch(opaque, signal, (uint8_t *)message->data.data, message->data.len);
+			otel_DispatchRecords(opaque, dispatch, signal,
+								 (uint8_t *)message->data.data, message->data.len);
 
 			/* Mark the slot unused and reclaim storage */
 			message->pid = 0;
@@ -240,7 +677,7 @@ otel_ProcessInput(struct otelIPC *ipc, void *opaque,
 }
 
 /*
- * Read zero or more messages from ipc. Each message is passed to dispatch.
+ * Read zero or more messages from ipc. Each record is passed to dispatch.
  */
 static void
 otel_ReceiveOverIPC(struct otelIPC *ipc, void *opaque,
@@ -274,8 +711,68 @@ otel_ReceiveOverIPC(struct otelIPC *ipc, void *opaque,
 		ipc->eof = true;
 }
 
+/*
+ * Read every message that is ready in the ring, if any. Each record is passed
+ * to dispatch while it is still in shared memory.
+ */
+static void
+otel_ReceiveOverRing(struct otelIPC *ipc, void *opaque,
+					 void (*dispatch)(void *opaque, bits8 signal,
+									  const uint8_t *message, size_t size))
+{
+	struct otelRing *ring = ipc->ring;
+	uint64 head, tail;
+
+	Assert(dispatch != NULL);
+
+	if (ring == NULL)
+		return;
+
+	tail = pg_atomic_read_u64(&ring->tail);
+	head = pg_atomic_read_u64(&ring->head);
+
+	while (tail < head)
+	{
+		uint64 offset = tail % ring->size;
+		uint64 length;
+		struct otelRingEntry *entry = (struct otelRingEntry *) (ring->data + offset);
+		uint32 state = entry->state;
+
+		/* Stop at a message that is reserved but not yet written */
+		if (state == PG_OTEL_RING_EMPTY)
+			break;
+
+		/* Read the message only after reading its state */
+		pg_read_barrier();
+
+		if (state == PG_OTEL_RING_SKIP)
+			length = ring->size - offset;
+		else
+		{
+			Assert(state == PG_OTEL_RING_READY);
+			Assert(entry->size <= ring->size - offset - PG_OTEL_RING_ALIGN);
+
+			otel_DispatchRecords(opaque, dispatch, entry->signal,
+								 ring->data + offset + PG_OTEL_RING_ALIGN, entry->size);
+
+			length = TYPEALIGN64(PG_OTEL_RING_ALIGN, PG_OTEL_RING_ALIGN + entry->size);
+		}
+
+		/* Zero the space before releasing it to writers */
+		MemSet(entry, 0, length);
+		tail += length;
+
+		pg_write_barrier();
+		pg_atomic_write_u64(&ring->tail, tail);
+	}
+}
+
 static inline bool
 otel_IPCIsIdle(struct otelIPC *ipc)
 {
-	return ipc->eof || (ipc->offset == 0 && ipc->unfinished == 0);
+	bool ringIsEmpty = (ipc->ring == NULL ||
+						pg_atomic_read_u64(&ipc->ring->head) ==
+						pg_atomic_read_u64(&ipc->ring->tail));
+
+	return ringIsEmpty && (ipc->eof || (ipc->offset == 0 && ipc->unfinished == 0));
 }
@@ -4,30 +4,111 @@
 #define PG_OTEL_IPC_H
 
 #include "postgres.h"
+#include "lib/stringinfo.h"
+#include "port/atomics.h"
 #include "postmaster/syslogger.h"
 #include "storage/latch.h"
+#include "utils/timestamp.h"
 
 #define PG_OTEL_IPC_FINISHED 0x01
+#define PG_OTEL_IPC_STARTED  0x02
 #define PG_OTEL_IPC_LOGS     0x10
 #define PG_OTEL_IPC_METRICS  0x20
 #define PG_OTEL_IPC_TRACES   0x40
 #define PG_OTEL_IPC_SIGNALS (PG_OTEL_IPC_LOGS | PG_OTEL_IPC_METRICS | PG_OTEL_IPC_TRACES)
 
+/* The most bytes of records a process holds before sending them */
+#define PG_OTEL_IPC_STAGE_SIZE 8192
+
+/* The pipe protocol header of PostgreSQL 15 renamed its flags field */
+#if PG_VERSION_NUM >= 150000
+#define PG_OTEL_IPC_FLAGS(header) ((header).flags)
+#else
+#define PG_OTEL_IPC_FLAGS(header) ((header).is_last)
+#endif
+
+/*
+ * otelRing is a queue of messages in shared memory with many writers and one
+ * reader. Writers reserve space by advancing head, and the reader consumes
+ * messages in place before advancing tail. Both positions only increase; the
+ * difference between them is the number of bytes in use.
+ *
+ * Every message starts on a PG_OTEL_RING_ALIGN boundary with an otelRingEntry
+ * header. Free space is always zeroed so the reader can tell when a reserved
+ * message is not yet written.
+ */
+#define PG_OTEL_RING_ALIGN 16
+#define PG_OTEL_RING_EMPTY 0x00
+#define PG_OTEL_RING_READY 0x01
+#define PG_OTEL_RING_SKIP  0x02
+
+struct otelRingEntry
+{
+	volatile uint32 state;
+	uint32 size;
+	bits8  signal;
+};
+struct otelRing
+{
+	pg_atomic_uint64 head;
+	pg_atomic_uint64 tail;
+	Latch *volatile  latch;
+	uint64           size;
+	uint8_t          data[FLEXIBLE_ARRAY_MEMBER];
+};
+
+/* Counters in shared memory */
+struct otelIPCStats
+{
+	pg_atomic_uint64 bytes;
+	pg_atomic_uint64 dropped;
+};
+
+/* A message that arrived over the pipe in more than one chunk */
+struct otelIPCPortion
+{
+	int32 pid;
+	StringInfoData data;
+};
+
 struct otelIPC
 {
-	List    *buckets[3][256];
+	List    *buckets[3][256]; /* struct otelIPCPortion */
 	uint8_t  buffer[2 * PIPE_CHUNK_SIZE];
 	int      offset, unfinished;
 	bool     eof;
 
+	/* When unfinished messages were last checked; see [otel_DiscardOrphans] */
+	TimestampTz orphansCheckedAt;
+
+	uint64               dropped; /* by this process */
+	struct otelRing     *ring;
+	struct otelIPCStats *stats;
+
+	/* Records waiting to be sent by this process */
+	uint8_t  staged[PG_OTEL_IPC_STAGE_SIZE];
+	size_t   stagedSize;
+	int      stagedCount;
+	bits8    stagedSignal;
+	bool     flushAtExit;
+
 #ifndef WIN32
 	int pipe[2];
 #endif
 };
 
 static uint32 otel_AddReadEventToSet(struct otelIPC *ipc, WaitEventSet *set);
+static void otel_AttachSharedMemory(struct otelIPC *ipc, Size capacity, int channel);
 static void otel_CloseWrite(struct otelIPC *ipc);
+static void otel_DetachSharedMemory(struct otelIPC *ipc);
+static void otel_DiscardOrphans(struct otelIPC *ipc);
+static void otel_FlushIPC(struct otelIPC *ipc);
+static uint64 otel_IPCBytes(struct otelIPC *ipc);
+static uint64 otel_IPCDropped(struct otelIPC *ipc);
+static Size otel_IPCSharedMemorySize(Size capacity);
 static void otel_OpenIPC(struct otelIPC *ipc);
+static Size otel_RingSize(Size capacity);
+static void otel_SetRingLatch(struct otelIPC *ipc, Latch *latch);
 
 static void
 otel_ReceiveOverIPC(struct otelIPC *ipc,
@@ -36,8 +117,19 @@ otel_ReceiveOverIPC(struct otelIPC *ipc,
 									 const uint8_t *message, size_t size));
 
 static void
-otel_SendOverIPC(struct otelIPC *ipc,
-				 bits8 signal, uint8_t *message, size_t size);
+otel_ReceiveOverRing(struct otelIPC *ipc,
+					 void *opaque,
+					 void (*dispatch)(void *opaque, bits8 signal,
+									  const uint8_t *message, size_t size));
+
+static uint8_t *
+otel_AllocateOverIPC(size_t size);
+
+static void
+otel_SendAllocatedOverIPC(struct otelIPC *ipc, bits8 signal, uint8_t *record);
+
+static uint8_t *
+otel_StageOverIPC(struct otelIPC *ipc, bits8 signal, size_t size);
 
 
 #endif
@@ -0,0 +1,144 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "storage/shmem.h"
+#include "utils/elog.h"
+
+#if PG_VERSION_NUM >= 150000
+#include "common/pg_prng.h"
+#endif
+
+#include "pg_otel.h"
+#include "pg_otel_config.h"
+#include "pg_otel_limit.h"
+
+/*
+ * Find or create the token buckets in shared memory. The caller should hold
+ * AddinShmemInitLock.
+ */
+static struct otelLimit *
+otel_AttachLimit(void)
+{
+	struct otelLimit *limit;
+	bool found;
+
+	limit = ShmemInitStruct(PG_OTEL_LIBRARY " limit", sizeof(*limit), &found);
+
+	if (!found)
+		for (int i = 0; i < PG_OTEL_LIMIT_BUCKETS; i++)
+		{
+			SpinLockInit(&limit->buckets[i].mutex);
+			limit->buckets[i].tokens = 0;
+			limit->buckets[i].refilled = 0;
+			pg_atomic_init_u64(&limit->buckets[i].suppressed, 0);
+		}
+
+	return limit;
+}
+
+static Size
+otel_LimitSharedMemorySize(void)
+{
+	return MAXALIGN(sizeof(struct otelLimit));
+}
+
+/* The bucket of log messages at elevel */
+static int
+otel_LimitBucket(int elevel)
+{
+	if (elevel < LOG)
+		return PG_OTEL_LIMIT_DEBUG;
+	if (elevel < WARNING)
+		return PG_OTEL_LIMIT_INFO;
+	if (elevel < ERROR)
+		return PG_OTEL_LIMIT_WARNING;
+	if (elevel == ERROR)
+		return PG_OTEL_LIMIT_ERROR;
+
+	return PG_OTEL_LIMIT_FATAL;
+}
+
+/* A random number in [0, 1) */
+static double
+otel_LimitRandom(void)
+{
+#if PG_VERSION_NUM >= 150000
+	return pg_prng_double(&pg_global_prng_state);
+#else
+	return (double) random() / ((double) MAX_RANDOM_VALUE + 1);
+#endif
+}
+
+/*
+ * Called by backends before encoding a log message at elevel. Messages below
+ * WARNING are sampled at otel.logs_sample_ratio, then every message takes a
+ * token from the bucket of its severity. Returns false and counts the message
+ * when it should be suppressed.
+ *
+ * Postmaster stays out of shared memory, so its messages are never limited.
+ */
+static bool
+otel_AllowLogMessage(struct otelLimit *limit,
+					 const struct otelConfiguration *config, int elevel)
+{
+	struct otelLimitBucket *bucket;
+	bool allow = true;
+	int  rate = 0;
+	int  i;
+
+	if (limit == NULL || !IsUnderPostmaster)
+		return true;
+
+	i = otel_LimitBucket(elevel);
+	bucket = &limit->buckets[i];
+
+	if (config->logs.rateLimit != NULL)
+		rate = config->logs.rateLimit->perSecond[i];
+
+	if (elevel < WARNING && config->logs.sampleRatio < 1 &&
+		otel_LimitRandom() >= config->logs.sampleRatio)
+		allow = false;
+
+	if (allow && rate > 0)
+	{
+		TimestampTz now = GetCurrentTimestamp();
+
+		SpinLockAcquire(&bucket->mutex);
+
+		if (now > bucket->refilled)
+		{
+			bucket->tokens = Min(rate, bucket->tokens +
+								 (double) (now - bucket->refilled) * rate / USECS_PER_SEC);
+			bucket->refilled = now;
+		}
+
+		if (bucket->tokens >= 1)
+			bucket->tokens -= 1;
+		else
+			allow = false;
+
+		SpinLockRelease(&bucket->mutex);
+	}
+
+	if (!allow)
+		pg_atomic_fetch_add_u64(&bucket->suppressed, 1);
+
+	return allow;
+}
+
+/*
+ * Called by the background worker to take the number of messages suppressed
+ * in bucket since the last time.
+ */
+static uint64
+otel_TakeSuppressed(struct otelLimit *limit, int bucket)
+{
+	Assert(bucket >= 0 && bucket < PG_OTEL_LIMIT_BUCKETS);
+
+	if (limit == NULL ||
+		pg_atomic_read_u64(&limit->buckets[bucket].suppressed) == 0)
+		return 0;
+
+	return pg_atomic_exchange_u64(&limit->buckets[bucket].suppressed, 0);
+}
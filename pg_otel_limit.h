@@ -0,0 +1,47 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#ifndef PG_OTEL_LIMIT_H
+#define PG_OTEL_LIMIT_H
+
+#include "postgres.h"
+#include "port/atomics.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+#include "pg_otel_config.h"
+
+/*
+ * otelLimitBucket is a token bucket for one of PG_OTEL_LIMIT_BUCKETS. It
+ * refills at the rate otel.logs_rate_limit sets for its severity per second
+ * and holds at most one second of tokens. Records that are rate limited
+ * or not sampled are counted in suppressed until the worker takes them.
+ */
+struct otelLimitBucket
+{
+	slock_t     mutex;
+	double      tokens;
+	TimestampTz refilled;
+
+	pg_atomic_uint64 suppressed;
+};
+
+/* otelLimit is in shared memory so every backend draws from the same buckets */
+struct otelLimit
+{
+	struct otelLimitBucket buckets[PG_OTEL_LIMIT_BUCKETS];
+};
+
+static struct otelLimit *
+otel_AttachLimit(void);
+
+static Size
+otel_LimitSharedMemorySize(void);
+
+static bool
+otel_AllowLogMessage(struct otelLimit *limit,
+					 const struct otelConfiguration *config, int elevel);
+
+static uint64
+otel_TakeSuppressed(struct otelLimit *limit, int bucket);
+
+#endif
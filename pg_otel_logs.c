@@ -6,12 +6,14 @@
 #include "common/string.h"
 #include "lib/stringinfo.h"
 #include "libpq/libpq-be.h"
+#include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "tcop/tcopprot.h"
 #include "utils/elog.h"
 #include "utils/memutils.h"
 
 #if PG_VERSION_NUM >= 140000
+#include "utils/backend_status.h"
 #include "utils/wait_event.h"
 #else
 #include "pgstat.h"
@@ -20,30 +22,252 @@
 #include "pg_otel.h"
 #include "pg_otel_ipc.h"
 #include "pg_otel_logs.h"
+#include "pg_otel_pipeline.h"
+#include "pg_otel_statement.h"
+#include "pg_otel_wait.h"
 
 static struct otelLogsBatch *otel_AddLogsBatch(struct otelLogsExporter *);
-static void otel_AddLogsResource(struct otelLogsBatch *, struct otelResource *);
+static void otel_AddLogsResource(struct otelLogsExporter *, struct otelLogsBatch *);
+static size_t otel_LogsResourceSize(const struct otelLogsExporter *,
+									const struct otelPackedResource *);
+static bool otel_RepeatLogMessage(struct otelLogsExporter *,
+								  const struct otelLogMessage *,
+								  const uint8_t *, size_t);
+static bool otel_SpillLogsBatch(struct otelLogsExporter *);
 
 /*
- * Called by backends to send one log message to the background worker.
+ * Called by backends to send one log message to the background worker. Values
+ * that become attributes are cut to otel.attribute_value_length_limit
+ * characters here, so a long statement costs no more than a short one. The
+ * statement is left out entirely when the same text with the same query_id
+ * was exported recently; see [otel_StatementSentRecently].
  */
 static void
-otel_SendLogMessage(struct otelIPC *ipc, const ErrorData *edata)
+otel_SendLogMessage(struct otelIPC *ipc, struct otelStatements *statements,
+					const ErrorData *edata, const struct otelConfiguration *config)
 {
-	struct otelLogRecord r;
+	struct otelLogMessage m = {};
+	const char *fields[PG_OTEL_LOG_FIELDS] = {};
 	struct timeval tv;
-	uint64_t unixNanoSec;
+	uint8_t *record, *staged;
+	size_t size = sizeof(m);
 
 	gettimeofday(&tv, NULL);
-	unixNanoSec = tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+	m.timeUnixNano = tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
 
-	otel_InitLogRecord(&r);
+	m.elevel = edata->elevel;
+	m.pid = MyProcPid; /* miscadmin.h */
+	m.sqlerrcode = edata->sqlerrcode;
 
-	r.record.body->string_value = edata->message;
-	r.record.body->value_case = OTEL_VALUE_CASE(STRING);
-	r.record.observed_time_unix_nano = unixNanoSec;
-	r.record.time_unix_nano = unixNanoSec;
+	fields[PG_OTEL_LOG_MESSAGE] = edata->message;
+	fields[PG_OTEL_LOG_FUNCNAME] = edata->funcname;
 
+	if (edata->filename != NULL)
+	{
+		fields[PG_OTEL_LOG_FILENAME] = edata->filename;
+		m.lineno = edata->lineno;
+	}
+
+	if (MyProcPort != NULL) /* miscadmin.h */
+	{
+		fields[PG_OTEL_LOG_DATABASE] = MyProcPort->database_name;
+		fields[PG_OTEL_LOG_USER] = MyProcPort->user_name;
+
+		/* TODO: MyProcPort->remote_host + MyProcPort->remote_port */
+	}
+
+#if PG_VERSION_NUM >= 140000
+	m.queryId = (uint64) pgstat_get_my_query_id(); /* backend_status.h */
+#endif
+
+	if (debug_query_string != NULL && !edata->hide_stmt) /* tcopprot.h */
+	{
+		m.cursorpos = edata->cursorpos;
+
+		/* Queries that differ only by constants share a query_id */
+		if (m.queryId != 0 &&
+			config->logs.statementDedup != PG_OTEL_CONFIG_STATEMENT_DEDUP_OFF)
+		{
+			INIT_CRC32C(m.statementHash);
+			COMP_CRC32C(m.statementHash, debug_query_string, strlen(debug_query_string));
+			FIN_CRC32C(m.statementHash);
+		}
+
+		if (otel_StatementSentRecently(statements, config,
+									   otel_StatementKey(m.queryId, m.statementHash)))
+			m.statementOmitted = true;
+		else
+			fields[PG_OTEL_LOG_STATEMENT] = debug_query_string;
+	}
+
+	if (edata->internalquery != NULL)
+	{
+		fields[PG_OTEL_LOG_INTERNAL_QUERY] = edata->internalquery;
+		m.internalpos = edata->internalpos;
+	}
+
+	if (!edata->hide_ctx)
+		fields[PG_OTEL_LOG_CONTEXT] = edata->context;
+
+	fields[PG_OTEL_LOG_HINT] = edata->hint;
+	fields[PG_OTEL_LOG_DETAIL] =
+		(edata->detail_log != NULL) ? edata->detail_log : edata->detail;
+
+	if (application_name != NULL && application_name[0] != '\0') /* guc.h */
+		fields[PG_OTEL_LOG_APPLICATION_NAME] = application_name;
+
+	/*
+	 * TODO: backend_type
+	 * TODO: session_id
+	 * TODO: vxid + txid
+	 * TODO: leader_pid
+	 */
+
+	/* Strings follow the fixed fields */
+	for (int i = 0; i < PG_OTEL_LOG_FIELDS; i++)
+		if (fields[i] != NULL)
+		{
+			int limit = config->attributeValueLengthLimit;
+
+			m.fields[i].offset = size;
+
+			/* The body is not an attribute */
+			if (limit < 0 || i == PG_OTEL_LOG_MESSAGE)
+				m.fields[i].length = strlen(fields[i]);
+			else
+			{
+				/* Read no further than limit characters could be */
+				size_t length = strnlen(fields[i], (size_t) limit *
+										pg_database_encoding_max_length());
+
+				m.fields[i].length = pg_mbcharcliplen(fields[i], length, limit);
+			}
+
+			size += m.fields[i].length + 1;
+		}
+
+	/*
+	 * Write directly into the IPC buffer when there is room, otherwise into
+	 * a message that is sent as it is.
+	 */
+	staged = otel_StageOverIPC(ipc, PG_OTEL_IPC_LOGS, size);
+	record = (staged != NULL) ? staged : otel_AllocateOverIPC(size);
+
+	memcpy(record, &m, sizeof(m));
+	for (int i = 0; i < PG_OTEL_LOG_FIELDS; i++)
+		if (fields[i] != NULL)
+		{
+			memcpy(record + m.fields[i].offset, fields[i], m.fields[i].length);
+			record[m.fields[i].offset + m.fields[i].length] = '\0';
+		}
+
+	if (staged == NULL)
+		otel_SendAllocatedOverIPC(ipc, PG_OTEL_IPC_LOGS, record);
+}
+
+/* Returns a string field of message m, or NULL when it is absent */
+static inline const char *
+otel_LogMessageField(const struct otelLogMessage *m, const uint8_t *message,
+					 int field)
+{
+	if (m->fields[field].offset == 0)
+		return NULL;
+
+	return (const char *) message + m->fields[field].offset;
+}
+
+/*
+ * Returns true when message of size bytes is a complete otelLogMessage. Its
+ * fixed fields are copied into m because message may not be aligned.
+ */
+static bool
+otel_CheckLogMessage(struct otelLogMessage *m,
+					 const uint8_t *message, size_t size)
+{
+	if (size < sizeof(*m))
+		return false;
+
+	memcpy(m, message, sizeof(*m));
+
+	for (int i = 0; i < PG_OTEL_LOG_FIELDS; i++)
+		if (m->fields[i].offset != 0)
+		{
+			if (m->fields[i].offset < sizeof(*m) ||
+				m->fields[i].offset >= size ||
+				m->fields[i].length >= size - m->fields[i].offset ||
+				message[m->fields[i].offset + m->fields[i].length] != '\0')
+				return false;
+		}
+
+	return true;
+}
+
+/*
+ * otelLogAttributes counts the attributes of one LogRecord against
+ * otel.attribute_count_limit. Those beyond the limit are counted in dropped.
+ */
+struct otelLogAttributes
+{
+	struct otelEncoder *e;
+	int    remaining;
+	uint32 dropped;
+};
+
+/*
+ * Write one attribute of a LogRecord with a string value. The key is already
+ * encoded; see PG_OTEL_LOG_KEY.
+ */
+static void
+otel_LogAttributeStr(struct otelLogAttributes *a, const char *key, size_t keySize,
+					 const char *value, size_t length)
+{
+	struct otelEncoder *e = a->e;
+	size_t anyValueSize = otel_LengthSize(length);
+
+	if (a->remaining <= 0)
+	{
+		a->dropped++;
+		return;
+	}
+	a->remaining--;
+
+	otel_EncodeLength(e, OTEL_WIRE_TAG(6, OTEL_WIRE_LEN),
+					  keySize + otel_VarintSize(anyValueSize) + anyValueSize);
+	otel_EncodeRaw(e, key, keySize);
+	otel_EncodeVarint(e, anyValueSize);
+	otel_EncodeString(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN), value, length);
+}
+
+/*
+ * Write one attribute of a LogRecord with an integer value. The key is already
+ * encoded; see PG_OTEL_LOG_KEY.
+ */
+static void
+otel_LogAttributeInt(struct otelLogAttributes *a, const char *key, size_t keySize,
+					 int64 value)
+{
+	struct otelEncoder *e = a->e;
+	uint64 varint = (uint64) (int64) value;
+	size_t anyValueSize = 1 + otel_VarintSize(varint);
+
+	if (a->remaining <= 0)
+	{
+		a->dropped++;
+		return;
+	}
+	a->remaining--;
+
+	otel_EncodeLength(e, OTEL_WIRE_TAG(6, OTEL_WIRE_LEN),
+					  keySize + otel_VarintSize(anyValueSize) + anyValueSize);
+	otel_EncodeRaw(e, key, keySize);
+	otel_EncodeVarint(e, anyValueSize);
+	otel_EncodeByte(e, OTEL_WIRE_TAG(3, OTEL_WIRE_VARINT));
+	otel_EncodeVarint(e, varint);
+}
+
+static void
+otel_LogSeverity(int elevel, int *number, const char **text)
+{
 	/*
 	 * Set severity number and text according to OpenTelemetry Log Data Model
 	 * and error_severity() in elog.c.
@@ -67,40 +291,40 @@ otel_SendLogMessage(struct otelIPC *ipc, const ErrorData *edata)
 	 * > meaning of the range then it is recommended to assign that severity
 	 * > the smallest value of the range.
 	 */
-	switch (edata->elevel)
+	switch (elevel)
 	{
 		case DEBUG5:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(TRACE);
-			r.record.severity_text = "DEBUG";
+			*number = OTEL_SEVERITY_NUMBER(TRACE);
+			*text = "DEBUG";
 			break;
 		case DEBUG4:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(TRACE2);
-			r.record.severity_text = "DEBUG";
+			*number = OTEL_SEVERITY_NUMBER(TRACE2);
+			*text = "DEBUG";
 			break;
 		case DEBUG3:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(TRACE3);
-			r.record.severity_text = "DEBUG";
+			*number = OTEL_SEVERITY_NUMBER(TRACE3);
+			*text = "DEBUG";
 			break;
 		case DEBUG2:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(TRACE4);
-			r.record.severity_text = "DEBUG";
+			*number = OTEL_SEVERITY_NUMBER(TRACE4);
+			*text = "DEBUG";
 			break;
 		case DEBUG1:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(DEBUG);
-			r.record.severity_text = "DEBUG";
+			*number = OTEL_SEVERITY_NUMBER(DEBUG);
+			*text = "DEBUG";
 			break;
 		case LOG:
 		case LOG_SERVER_ONLY:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(INFO);
-			r.record.severity_text = "LOG";
+			*number = OTEL_SEVERITY_NUMBER(INFO);
+			*text = "LOG";
 			break;
 		case INFO:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(INFO);
-			r.record.severity_text = "INFO";
+			*number = OTEL_SEVERITY_NUMBER(INFO);
+			*text = "INFO";
 			break;
 		case NOTICE:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(INFO2);
-			r.record.severity_text = "NOTICE";
+			*number = OTEL_SEVERITY_NUMBER(INFO2);
+			*text = "NOTICE";
 			break;
 		case WARNING:
 #if PG_VERSION_NUM >= 140000
@@ -110,390 +334,2059 @@ otel_SendLogMessage(struct otelIPC *ipc, const ErrorData *edata)
 			 * it is included here for completeness.
 			 */
 #endif
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(WARN);
-			r.record.severity_text = "WARNING";
+			*number = OTEL_SEVERITY_NUMBER(WARN);
+			*text = "WARNING";
 			break;
 		case ERROR:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(ERROR);
-			r.record.severity_text = "ERROR";
+			*number = OTEL_SEVERITY_NUMBER(ERROR);
+			*text = "ERROR";
 			break;
 		case FATAL:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(FATAL);
-			r.record.severity_text = "FATAL";
+			*number = OTEL_SEVERITY_NUMBER(FATAL);
+			*text = "FATAL";
 			break;
 		case PANIC:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(FATAL2);
-			r.record.severity_text = "PANIC";
+			*number = OTEL_SEVERITY_NUMBER(FATAL2);
+			*text = "PANIC";
 			break;
 		default:
-			r.record.severity_number = OTEL_SEVERITY_NUMBER(FATAL2);
+			*number = OTEL_SEVERITY_NUMBER(FATAL2);
+			*text = NULL;
 	}
 
+}
+
+/*
+ * Called by the background worker to write message m as the fields of one
+ * LogRecord with at most attributeLimit attributes. When m has no statement,
+ * the one in statement is used, if any. This allocates nothing, and it writes
+ * nothing when e->out is NULL.
+ */
+static void
+otel_EncodeLogRecord(struct otelEncoder *e, const struct otelLogMessage *m,
+					 const uint8_t *message, const struct otelLogsStatement *statement,
+					 int attributeLimit)
+{
+	struct otelLogAttributes a = { .e = e, .remaining = attributeLimit };
+	const char *text, *value;
+	size_t length;
+	int number;
+
+	otel_LogSeverity(m->elevel, &number, &text);
+
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(1, OTEL_WIRE_FIXED64), m->timeUnixNano);
+	otel_EncodeByte(e, OTEL_WIRE_TAG(2, OTEL_WIRE_VARINT));
+	otel_EncodeVarint(e, number);
+
+	if (text != NULL)
+		otel_EncodeString(e, OTEL_WIRE_TAG(3, OTEL_WIRE_LEN), text, strlen(text));
+
+	/* The body is an AnyValue with a string value */
+	value = otel_LogMessageField(m, message, PG_OTEL_LOG_MESSAGE);
+	length = m->fields[PG_OTEL_LOG_MESSAGE].length;
+	if (value == NULL)
+		value = "";
+	otel_EncodeLength(e, OTEL_WIRE_TAG(5, OTEL_WIRE_LEN), otel_LengthSize(length));
+	otel_EncodeString(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN), value, length);
+
 	/*
 	 * Set attributes according to OpenTelemetry Semantic Conventions.
 	 * - https://docs.opentelemetry.io/reference/specification/overview/
 	 */
+#define LOG_ATTRIBUTE_FIELD(key, field) \
+	otel_LogAttributeStr(&a, PG_OTEL_LOG_KEY(key), value, m->fields[field].length)
 
-	if (MyProcPid != 0) /* miscadmin.h */
-		otel_LogAttributeInt(&r, "process.pid", MyProcPid);
+	if (m->pid != 0)
+		otel_LogAttributeInt(&a, PG_OTEL_LOG_KEY(PROCESS_PID), m->pid);
 
-	if (edata->funcname != NULL)
-		otel_LogAttributeStr(&r, "code.function", edata->funcname);
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_FUNCNAME)) != NULL)
+		LOG_ATTRIBUTE_FIELD(CODE_FUNCTION, PG_OTEL_LOG_FUNCNAME);
 
-	if (edata->filename != NULL)
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_FILENAME)) != NULL)
 	{
-		otel_LogAttributeStr(&r, "code.filepath", edata->filename);
-		otel_LogAttributeInt(&r, "code.lineno", edata->lineno);
+		LOG_ATTRIBUTE_FIELD(CODE_FILEPATH, PG_OTEL_LOG_FILENAME);
+		otel_LogAttributeInt(&a, PG_OTEL_LOG_KEY(CODE_LINENO), m->lineno);
 	}
 
-	if (MyProcPort != NULL) /* miscadmin.h */
-	{
-		if (MyProcPort->database_name != NULL)
-			otel_LogAttributeStr(&r, "db.name", MyProcPort->database_name);
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_DATABASE)) != NULL)
+		LOG_ATTRIBUTE_FIELD(DB_NAME, PG_OTEL_LOG_DATABASE);
 
-		if (MyProcPort->user_name != NULL)
-			otel_LogAttributeStr(&r, "db.user", MyProcPort->user_name);
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_USER)) != NULL)
+		LOG_ATTRIBUTE_FIELD(DB_USER, PG_OTEL_LOG_USER);
 
-		/* TODO: MyProcPort->remote_host + MyProcPort->remote_port */
+	value = otel_LogMessageField(m, message, PG_OTEL_LOG_STATEMENT);
+	length = m->fields[PG_OTEL_LOG_STATEMENT].length;
+	if (value == NULL && statement != NULL)
+	{
+		value = statement->text;
+		length = statement->length;
 	}
-
-	if (debug_query_string != NULL && !edata->hide_stmt) /* tcopprot.h */
+	if (value != NULL)
 	{
-		otel_LogAttributeStr(&r, "db.statement", debug_query_string);
+		otel_LogAttributeStr(&a, PG_OTEL_LOG_KEY(DB_STATEMENT), value, length);
 
-		if (edata->cursorpos > 0)
-			otel_LogAttributeInt(&r, "db.postgresql.cursor_position", edata->cursorpos);
+		if (m->cursorpos > 0)
+			otel_LogAttributeInt(&a, PG_OTEL_LOG_KEY(DB_POSTGRESQL_CURSOR_POSITION),
+								 m->cursorpos);
 	}
 
-	if (edata->internalquery != NULL)
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_INTERNAL_QUERY)) != NULL)
 	{
-		otel_LogAttributeStr(&r, "db.postgresql.internal_query", edata->internalquery);
+		LOG_ATTRIBUTE_FIELD(DB_POSTGRESQL_INTERNAL_QUERY, PG_OTEL_LOG_INTERNAL_QUERY);
 
-		if (edata->internalpos > 0)
-			otel_LogAttributeInt(&r, "db.postgresql.internal_position", edata->internalpos);
+		if (m->internalpos > 0)
+			otel_LogAttributeInt(&a, PG_OTEL_LOG_KEY(DB_POSTGRESQL_INTERNAL_POSITION),
+								 m->internalpos);
 	}
 
-	if (edata->context != NULL && !edata->hide_ctx)
-		otel_LogAttributeStr(&r, "db.postgresql.context", edata->context);
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_CONTEXT)) != NULL)
+		LOG_ATTRIBUTE_FIELD(DB_POSTGRESQL_CONTEXT, PG_OTEL_LOG_CONTEXT);
 
-	if (edata->sqlerrcode != 0)
-		otel_LogAttributeStr(&r, "db.postgresql.state_code", unpack_sql_state(edata->sqlerrcode));
+	if (m->queryId != 0)
+		otel_LogAttributeInt(&a, PG_OTEL_LOG_KEY(DB_POSTGRESQL_QUERY_ID),
+							 (int64) m->queryId);
 
-	if (edata->hint != NULL)
-		otel_LogAttributeStr(&r, "db.postgresql.hint", edata->hint);
-
-	if (edata->detail_log != NULL)
-		otel_LogAttributeStr(&r, "db.postgresql.detail", edata->detail_log);
+	if (m->sqlerrcode != 0)
+	{
+		value = unpack_sql_state(m->sqlerrcode);
+		otel_LogAttributeStr(&a, PG_OTEL_LOG_KEY(DB_POSTGRESQL_STATE_CODE),
+							 value, strlen(value));
+	}
 
-	else if (edata->detail != NULL)
-		otel_LogAttributeStr(&r, "db.postgresql.detail", edata->detail);
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_HINT)) != NULL)
+		LOG_ATTRIBUTE_FIELD(DB_POSTGRESQL_HINT, PG_OTEL_LOG_HINT);
 
-	if (application_name != NULL && application_name[0] != '\0') /* guc.h */
-		otel_LogAttributeStr(&r, "db.postgresql.application_name", application_name);
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_DETAIL)) != NULL)
+		LOG_ATTRIBUTE_FIELD(DB_POSTGRESQL_DETAIL, PG_OTEL_LOG_DETAIL);
 
-	/*
-	 * TODO: backend_type
-	 * TODO: session_id
-	 * TODO: vxid + txid
-	 * TODO: leader_pid
-	 * TODO: query_id
-	 */
+	if ((value = otel_LogMessageField(m, message, PG_OTEL_LOG_APPLICATION_NAME)) != NULL)
+		LOG_ATTRIBUTE_FIELD(DB_POSTGRESQL_APPLICATION_NAME, PG_OTEL_LOG_APPLICATION_NAME);
 
+	if (m->repeatCount > 0)
 	{
-		uint8_t *packed = palloc(OTEL_FUNC_LOGS(log_record__get_packed_size)(&r.record));
-		size_t size = OTEL_FUNC_LOGS(log_record__pack)(&r.record, packed);
+		otel_LogAttributeInt(&a, PG_OTEL_LOG_KEY(PG_OTEL_REPEAT_COUNT), m->repeatCount);
+		otel_LogAttributeInt(&a, PG_OTEL_LOG_KEY(PG_OTEL_REPEAT_FIRST_TIME_UNIX_NANO),
+							 (int64) m->repeatFirstUnixNano);
+	}
 
-		otel_SendOverIPC(ipc, PG_OTEL_IPC_LOGS, packed, size);
+#undef LOG_ATTRIBUTE_FIELD
 
-		pfree(packed);
+	if (a.dropped > 0)
+	{
+		otel_EncodeByte(e, OTEL_WIRE_TAG(7, OTEL_WIRE_VARINT));
+		otel_EncodeVarint(e, a.dropped);
 	}
+
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(11, OTEL_WIRE_FIXED64), m->timeUnixNano);
 }
 
 /*
- * Called by the background worker to put a log message in the exporter queue.
+ * Called by the background worker to export one log record at elevel in place
+ * of count that backends suppressed.
  */
 static void
-otel_ReceiveLogMessage(struct otelLogsExporter *exporter,
-					   const uint8_t *packed, size_t size)
+otel_ReceiveSuppressedLogs(struct otelLogsExporter *exporter,
+						   int elevel, uint64 count)
 {
-	struct otelLogsBatch *batch;
-	OTEL_TYPE_LOGS(LogRecord) *record;
-	OTEL_TYPE_LOGS(ResourceLogs) *resourceLogs;
+	struct otelLogMessage m = {};
+	uint8_t message[sizeof(m) + 128];
+	char *text = (char *) message + sizeof(m);
+	struct timeval tv;
+	int length;
 
-	if (dlist_is_empty(&exporter->queue))
-		batch = otel_AddLogsBatch(exporter);
-	else
-		batch = dlist_tail_element(struct otelLogsBatch, list_node,
-								   &exporter->queue);
+	gettimeofday(&tv, NULL);
+	m.timeUnixNano = tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+	m.elevel = elevel;
+	m.pid = MyProcPid;
+
+	length = snprintf(text, sizeof(message) - sizeof(m),
+					  UINT64_FORMAT " similar log records were suppressed", count);
+	m.fields[PG_OTEL_LOG_MESSAGE].offset = sizeof(m);
+	m.fields[PG_OTEL_LOG_MESSAGE].length = length;
+	memcpy(message, &m, sizeof(m));
+
+	exporter->stats.suppressed += count;
+	otel_ReceiveLogMessage(exporter, message, sizeof(m) + length + 1);
+}
 
-	if (exporter->queueLength >= exporter->queueMax)
-		batch->dropped++;
-	else
+/* A hash of the parts of message m that make it the same as another */
+static pg_crc32c
+otel_LogMessageHash(const struct otelLogMessage *m, const uint8_t *message)
+{
+	static const int fields[] = {
+		PG_OTEL_LOG_MESSAGE, PG_OTEL_LOG_FILENAME, PG_OTEL_LOG_FUNCNAME,
+	};
+	pg_crc32c crc;
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, &m->elevel, sizeof(m->elevel));
+	COMP_CRC32C(crc, &m->sqlerrcode, sizeof(m->sqlerrcode));
+	COMP_CRC32C(crc, &m->lineno, sizeof(m->lineno));
+
+	/* Include each terminal null so fields cannot run together */
+	for (int i = 0; i < lengthof(fields); i++)
 	{
-		/* unpack returns NULL when it cannot unpack the message */
-		record = OTEL_FUNC_LOGS(log_record__unpack)
-			(&batch->allocator, size, packed);
-
-		if (record == NULL)
-			batch->dropped++;
-		else
-		{
-			if (batch->length >= batch->capacity)
-				batch = otel_AddLogsBatch(exporter);
-
-			batch->records[batch->length] = record;
-			batch->length++;
-			exporter->queueLength++;
+		const char *value = otel_LogMessageField(m, message, fields[i]);
 
-			resourceLogs = llast(batch->resourceLogs);
-			resourceLogs->scope_logs[0]->n_log_records++;
-		}
+		if (value != NULL)
+			COMP_CRC32C(crc, value, m->fields[fields[i]].length + 1);
 	}
+
+	FIN_CRC32C(crc);
+	return crc;
 }
 
-/*
- * Allocate a batch in its own top-level context and append it to exporter's queue.
- */
-static struct otelLogsBatch *
-otel_AddLogsBatch(struct otelLogsExporter *exporter)
+/* Whether messages a and b have the same body, severity, SQLSTATE, and code */
+static bool
+otel_SameLogMessage(const struct otelLogMessage *a, const uint8_t *aMessage,
+					const struct otelLogMessage *b, const uint8_t *bMessage)
 {
-	MemoryContext ctx = AllocSetContextCreate(NULL, /* parent */
-											  PG_OTEL_LIBRARY " logs batch",
-											  ALLOCSET_START_SMALL_SIZES);
-	struct otelLogsBatch *batch = MemoryContextAllocZero(ctx, sizeof(*batch));
+	static const int fields[] = {
+		PG_OTEL_LOG_MESSAGE, PG_OTEL_LOG_FILENAME, PG_OTEL_LOG_FUNCNAME,
+	};
 
-	batch->capacity = exporter->batchMax;
-	batch->context = ctx;
-	batch->records = MemoryContextAlloc(batch->context,
-										sizeof(*(batch->records)) *
-										batch->capacity);
+	if (a->elevel != b->elevel || a->sqlerrcode != b->sqlerrcode ||
+		a->lineno != b->lineno)
+		return false;
 
-	otel_InitProtobufCAllocator(&batch->allocator, batch->context);
-	otel_AddLogsResource(batch, &exporter->resource);
+	for (int i = 0; i < lengthof(fields); i++)
+	{
+		const char *aValue = otel_LogMessageField(a, aMessage, fields[i]);
+		const char *bValue = otel_LogMessageField(b, bMessage, fields[i]);
 
-	dlist_push_tail(&exporter->queue, &batch->list_node);
+		if ((aValue == NULL) != (bValue == NULL))
+			return false;
 
-	return batch;
+		if (aValue != NULL &&
+			(a->fields[fields[i]].length != b->fields[fields[i]].length ||
+			 memcmp(aValue, bValue, a->fields[fields[i]].length) != 0))
+			return false;
+	}
+
+	return true;
 }
 
 /*
- * Store a copy of resource in batch to be exported with any following records.
+ * Called by the background worker before queueing message m. Returns true
+ * when it repeats one exported within otel.logs_dedup_interval; it is then
+ * counted toward one record later by [otel_FlushRepeatedLogs]. Otherwise, m
+ * is remembered so that later messages can repeat it.
  */
-static void
-otel_AddLogsResource(struct otelLogsBatch *batch, struct otelResource *resource)
-{
-	MemoryContext oldContext = MemoryContextSwitchTo(batch->context);
-	OTEL_TYPE_LOGS(ResourceLogs)  data;
-	OTEL_TYPE_LOGS(ResourceLogs) *next;
-	OTEL_TYPE_LOGS(ScopeLogs)     scopeLogsData;
-	OTEL_TYPE_LOGS(ScopeLogs)    *scopeLogsList[1] = { &scopeLogsData };
-	uint8_t *packed;
-	size_t size;
+static bool
+otel_RepeatLogMessage(struct otelLogsExporter *exporter,
+					  const struct otelLogMessage *m,
+					  const uint8_t *message, size_t size)
+{
+	struct otelLogsRepeat *repeat;
+	struct otelLogMessage first;
+	pg_crc32c key;
 
-	/* Prepare a ResourceLogs object containing a list of one ScopeLogs */
-	OTEL_FUNC_LOGS(resource_logs__init)(&data);
-	OTEL_FUNC_LOGS(scope_logs__init)(&scopeLogsData);
-	data.resource = &resource->resource;
-	data.scope_logs = scopeLogsList;
-	data.n_scope_logs = 1;
+	if (exporter->repeatIntervalMS == 0 || m->repeatCount > 0)
+		return false;
 
-	/* Copy it into the MemoryContext of the batch */
-	packed = palloc(OTEL_FUNC_LOGS(resource_logs__get_packed_size)(&data));
-	size = OTEL_FUNC_LOGS(resource_logs__pack)(&data, packed);
-	next = OTEL_FUNC_LOGS(resource_logs__unpack)(&batch->allocator, size, packed);
-	pfree(packed);
+	key = otel_LogMessageHash(m, message);
+	repeat = hash_search(exporter->repeats, &key, HASH_FIND, NULL);
 
-	/* Point that copy at the current position in the list of LogRecords */
-	next->scope_logs[0]->log_records = batch->records + batch->length;
-	next->scope_logs[0]->n_log_records = 0;
+	if (repeat != NULL)
+	{
+		memcpy(&first, repeat->message, sizeof(first));
 
-	batch->resourceLogs = lappend(batch->resourceLogs, next);
+		/* Different messages can have the same hash */
+		if (!otel_SameLogMessage(&first, repeat->message, m, message))
+			return false;
+
+		repeat->count++;
+		repeat->lastUnixNano = m->timeUnixNano;
+		return true;
+	}
+
+	if (hash_get_num_entries(exporter->repeats) >= PG_OTEL_LOGS_REPEATS_MAX)
+		return false;
+
+	repeat = hash_search(exporter->repeats, &key, HASH_ENTER, NULL);
+	repeat->message = MemoryContextAlloc(exporter->repeatsContext, size);
+	repeat->size = size;
+	repeat->count = 0;
+	repeat->deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+												   exporter->repeatIntervalMS);
+	memcpy(repeat->message, message, size);
+	dlist_push_tail(&exporter->repeatsOrder, &repeat->list_node);
 
-	MemoryContextSwitchTo(oldContext);
+	return false;
 }
 
 /*
- * Send request to the collector configured in exporter, ignoring any errors.
+ * Called by the background worker to stop counting repeats of messages whose
+ * time is up, or of every message when flush is true. Messages that repeated
+ * are exported once more with the time of the last repeat.
  */
 static void
-otel_SendLogsRequestToCollector(MemoryContext ctx, CURL *http,
-								struct otelLogsExporter *exporter,
-								OTEL_TYPE_EXPORT_LOGS(Request) *request)
+otel_FlushRepeatedLogs(struct otelLogsExporter *exporter, bool flush)
 {
-	uint8_t *body = NULL;
-	char     httpErrorBuffer[CURL_ERROR_SIZE];
-	CURLcode result;
-	size_t   size;
+	TimestampTz now = GetCurrentTimestamp();
 
-	struct curl_slist *headers = NULL;
-
-	size = OTEL_FUNC_EXPORT_LOGS(request__get_packed_size)(request);
-	body = MemoryContextAlloc(ctx, size);
-	size = OTEL_FUNC_EXPORT_LOGS(request__pack)(request, body);
-
-	/* These do not error or their error can be ignored */
-	curl_easy_reset(http);
-	curl_easy_setopt(http, CURLOPT_ERRORBUFFER, httpErrorBuffer);
-	curl_easy_setopt(http, CURLOPT_CONNECTTIMEOUT_MS, 1 + (exporter->timeoutMS / 2));
-	curl_easy_setopt(http, CURLOPT_TIMEOUT_MS, exporter->timeoutMS);
-	curl_easy_setopt(http, CURLOPT_USERAGENT, PG_OTEL_USERAGENT);
-
-	if (exporter->insecure)
+	while (!dlist_is_empty(&exporter->repeatsOrder))
 	{
-		curl_easy_setopt(http, CURLOPT_SSL_VERIFYHOST, 0);
-		curl_easy_setopt(http, CURLOPT_SSL_VERIFYPEER, 0);
-	}
+		struct otelLogsRepeat *repeat =
+			dlist_head_element(struct otelLogsRepeat, list_node,
+							   &exporter->repeatsOrder);
+		struct otelLogMessage m;
+		pg_crc32c key = repeat->key;
 
-	/* TODO: check errors */
-	result = curl_easy_setopt(http, CURLOPT_URL, exporter->endpoint);
+		if (!flush && now < repeat->deadline)
+			break;
 
-	/* TODO: check errors */
-	headers = curl_slist_append(headers, PG_OTEL_HEADER_PROTOBUF);
+		dlist_delete(&repeat->list_node);
 
-	curl_easy_setopt(http, CURLOPT_HTTPHEADER, headers);
+		if (repeat->count > 0)
+		{
+			/* The first time is that of the record that was exported */
+			memcpy(&m, repeat->message, sizeof(m));
+			m.repeatFirstUnixNano = m.timeUnixNano;
+			m.timeUnixNano = repeat->lastUnixNano;
+			m.repeatCount = repeat->count;
+			memcpy(repeat->message, &m, sizeof(m));
+
+			otel_ReceiveLogMessage(exporter, repeat->message, repeat->size);
+		}
 
-	/*
-	 * TODO: gzip encoding
-	 * TODO: retry and backoff
-	 * - https://opentelemetry.io/docs/reference/specification/protocol/otlp/
-	 * - https://opentelemetry.io/docs/reference/specification/protocol/exporter/
-	 */
+		pfree(repeat->message);
+		hash_search(exporter->repeats, &key, HASH_REMOVE, NULL);
+	}
+}
 
-#ifdef PG_OTEL_DEBUG
-	/* Print debugging information to stderr; off by default */
-	curl_easy_setopt(http, CURLOPT_VERBOSE, 1);
-#endif
+/*
+ * Called by the background worker to find when the next messages stop being
+ * counted as repeats. Returns false when there are none.
+ */
+static bool
+otel_RepeatedLogsDeadline(struct otelLogsExporter *exporter, TimestampTz *deadline)
+{
+	if (dlist_is_empty(&exporter->repeatsOrder))
+		return false;
 
-	curl_easy_setopt(http, CURLOPT_POST, 1);
-	curl_easy_setopt(http, CURLOPT_POSTFIELDS, body);
-	curl_easy_setopt(http, CURLOPT_POSTFIELDSIZE, size);
+	*deadline = dlist_head_element(struct otelLogsRepeat, list_node,
+								   &exporter->repeatsOrder)->deadline;
+	return true;
+}
 
-	result = curl_easy_perform(http);
+/*
+ * Forget statements that expire before now.
+ */
+static void
+otel_ExpireStatements(struct otelLogsExporter *exporter, TimestampTz now)
+{
+	while (!dlist_is_empty(&exporter->statementsOrder))
+	{
+		struct otelLogsStatement *statement =
+			dlist_head_element(struct otelLogsStatement, list_node,
+							   &exporter->statementsOrder);
+		uint64 key = statement->key;
 
-	/* TODO: check errors */
-	result = result;
+		if (now < statement->expires)
+			break;
 
-	curl_slist_free_all(headers);
-	curl_easy_reset(http);
-	pfree(body);
+		dlist_delete(&statement->list_node);
+		pfree(statement->text);
+		hash_search(exporter->statements, &key, HASH_REMOVE, NULL);
+	}
 }
 
 /*
- * Called by the background worker to send a batch to the collector.
+ * Called by the background worker to keep the statement of message m for
+ * messages that arrive without it. Backends send it again at least every
+ * otel.logs_statement_dedup_interval after it is exported, so it is kept for
+ * twice that long; see also [otel_KeepStatement].
  */
 static void
-otel_SendLogsToCollector(struct otelLogsExporter *exporter, CURL *http)
+otel_RememberStatement(struct otelLogsExporter *exporter,
+					   const struct otelLogMessage *m, const uint8_t *message)
 {
-	struct otelLogsBatch *batch;
-	OTEL_TYPE_EXPORT_LOGS(Request) request;
-	OTEL_TYPE_COMMON(InstrumentationScope) scopeData;
-	ListCell *cell;
-
-	if (dlist_is_empty(&exporter->queue))
+	struct otelLogsStatement *statement;
+	const char *value = otel_LogMessageField(m, message, PG_OTEL_LOG_STATEMENT);
+	size_t length = m->fields[PG_OTEL_LOG_STATEMENT].length;
+	uint64 key = otel_StatementKey(m->queryId, m->statementHash);
+	TimestampTz now;
+	bool found;
+
+	if (exporter->statementDedup != PG_OTEL_CONFIG_STATEMENT_DEDUP_REATTACH ||
+		key == 0 || value == NULL)
 		return;
 
-	OTEL_FUNC_EXPORT_LOGS(request__init)(&request);
-	OTEL_FUNC_COMMON(instrumentation_scope__init)(&scopeData);
+	now = GetCurrentTimestamp();
+	otel_ExpireStatements(exporter, now);
 
-	/*
-	 * All log records come from the same instrumentation scope: this module.
-	 * - https://docs.opentelemetry.io/reference/specification/glossary/#instrumentation-scope
-	 */
-	scopeData.name = PG_OTEL_LIBRARY;
-	scopeData.version = PG_OTEL_VERSION;
+	/* Make room by forgetting the one that expires first */
+	if (hash_get_num_entries(exporter->statements) >= PG_OTEL_LOGS_STATEMENTS_MAX &&
+		hash_search(exporter->statements, &key, HASH_FIND, NULL) == NULL)
+		otel_ExpireStatements(exporter,
+							  dlist_head_element(struct otelLogsStatement, list_node,
+												 &exporter->statementsOrder)->expires);
 
-	batch = dlist_head_element(struct otelLogsBatch, list_node,
-							   &exporter->queue);
+	statement = hash_search(exporter->statements, &key, HASH_ENTER, &found);
 
-	request.n_resource_logs = batch->resourceLogs->length;
-	request.resource_logs = MemoryContextAlloc(batch->context,
-											   sizeof(*request.resource_logs) *
-											   request.n_resource_logs);
+	if (found)
+	{
+		dlist_delete(&statement->list_node);
+
+		if (statement->length != length || memcmp(statement->text, value, length) != 0)
+		{
+			pfree(statement->text);
+			found = false;
+		}
+	}
 
-	cell = list_head(batch->resourceLogs);
-	for (int i = 0; i < request.n_resource_logs; i++)
+	if (!found)
 	{
-		request.resource_logs[i] = lfirst(cell);
-		request.resource_logs[i]->schema_url = PG_OTEL_SCHEMA;
-		request.resource_logs[i]->scope_logs[0]->schema_url = PG_OTEL_SCHEMA;
-		request.resource_logs[i]->scope_logs[0]->scope = &scopeData;
-#if PG_VERSION_NUM >= 130000
-		cell = lnext(batch->resourceLogs, cell);
-#else
-		cell = lnext(cell);
-#endif
+		statement->text = MemoryContextAlloc(exporter->statementsContext, length + 1);
+		statement->length = length;
+		memcpy(statement->text, value, length + 1);
 	}
 
-	otel_SendLogsRequestToCollector(batch->context, http, exporter, &request);
+	statement->expires =
+		TimestampTzPlusMilliseconds(now, 2 * exporter->statementIntervalMS);
+	dlist_push_tail(&exporter->statementsOrder, &statement->list_node);
+}
+
+/*
+ * Called by the background worker to find the statement that message m was
+ * sent without. Only one with the same text will do, so this returns NULL
+ * when there is none or it should be omitted.
+ */
+static const struct otelLogsStatement *
+otel_FindStatement(struct otelLogsExporter *exporter, const struct otelLogMessage *m)
+{
+	uint64 key = otel_StatementKey(m->queryId, m->statementHash);
 
-	dlist_pop_head_node(&exporter->queue);
-	exporter->queueLength -= batch->length;
+	if (exporter->statementDedup != PG_OTEL_CONFIG_STATEMENT_DEDUP_REATTACH ||
+		!m->statementOmitted)
+		return NULL;
 
-	MemoryContextDelete(batch->context);
+	return hash_search(exporter->statements, &key, HASH_FIND, NULL);
 }
 
-static void
-otel_InitLogsExporter(struct otelLogsExporter *exporter,
-					  const struct otelConfiguration *config)
+/*
+ * The statement key of message m when a backend sent it with the text of its
+ * statement. Returns zero otherwise, or when statements are always sent.
+ */
+static uint64
+otel_SentStatementKey(struct otelLogsExporter *exporter,
+					  const struct otelLogMessage *m, const uint8_t *message)
 {
-	dlist_init(&exporter->queue);
-	exporter->endpoint = NULL;
-	exporter->queueLength = 0;
+	if (exporter->statementDedup == PG_OTEL_CONFIG_STATEMENT_DEDUP_OFF ||
+		otel_LogMessageField(m, message, PG_OTEL_LOG_STATEMENT) == NULL)
+		return 0;
 
-	otel_InitResource(&exporter->resource);
-	otel_LoadLogsConfig(exporter, config);
+	return otel_StatementKey(m->queryId, m->statementHash);
 }
 
 /*
- * Called by the background worker when PostgreSQL configuration changes.
+ * Called by the background worker when a record with the statement of key is
+ * exported. Backends leave that text out from now on, so it is kept for twice
+ * otel.logs_statement_dedup_interval from now, however long the record waited
+ * to be exported. Returns false when it was already forgotten.
+ */
+static bool
+otel_KeepStatement(struct otelLogsExporter *exporter, uint64 key, TimestampTz now)
+{
+	struct otelLogsStatement *statement =
+		hash_search(exporter->statements, &key, HASH_FIND, NULL);
+
+	if (statement == NULL)
+		return false;
+
+	/* The order of expiry stays the same, because this one is the latest */
+	dlist_delete(&statement->list_node);
+	statement->expires =
+		TimestampTzPlusMilliseconds(now, 2 * exporter->statementIntervalMS);
+	dlist_push_tail(&exporter->statementsOrder, &statement->list_node);
+	return true;
+}
+
+/*
+ * Called by the background worker once the records of batch are exported or
+ * dropped. Backends leave out the statements those carried for a while after
+ * they are exported, and send them again after they are dropped. When the
+ * worker puts statements back, backends leave out only those it still has.
  */
 static void
-otel_LoadLogsConfig(struct otelLogsExporter *exporter,
-					const struct otelConfiguration *config)
+otel_SettleStatements(struct otelLogsExporter *exporter,
+					  const struct otelLogsBatch *batch, bool exported)
 {
-	otel_LoadResource(config, &exporter->resource);
+	bool reattach = (exporter->statementDedup == PG_OTEL_CONFIG_STATEMENT_DEDUP_REATTACH);
+	TimestampTz now = GetCurrentTimestamp();
+
+	for (int i = 0; i < batch->length; i++)
+	{
+		uint64 key = batch->records[i].statementKey;
+
+		if (key == 0)
+			continue;
+
+		if (!exported)
+			otel_ForgetStatement(exporter->statementsSent, key);
+		else if (!reattach || otel_KeepStatement(exporter, key, now))
+			otel_MarkStatementSent(exporter->statementsSent, key);
+	}
+}
+
+/*
+ * Called by the background worker to put a log message in the exporter queue.
+ * The message is encoded right away as one element of ScopeLogs.log_records.
+ */
+static void
+otel_ReceiveLogMessage(struct otelLogsExporter *exporter,
+					   const uint8_t *message, size_t size)
+{
+	struct otelLogsBatch *batch;
+	struct otelLogsRecord *record;
+	struct otelLogsResource *resource;
+	struct otelLogMessage m;
+
+	exporter->stats.received++;
+
+	/* Make room by moving the oldest batch to disk */
+	if (exporter->queueLength >= exporter->queueMax)
+		otel_SpillLogsBatch(exporter);
+
+	if (dlist_is_empty(&exporter->queue))
+		batch = otel_AddLogsBatch(exporter);
+	else
+		batch = dlist_tail_element(struct otelLogsBatch, list_node,
+								   &exporter->queue);
+
+	if (exporter->queueLength >= exporter->queueMax)
+	{
+		batch->dropped++;
+		exporter->stats.dropped[PG_OTEL_LOGS_DROPPED_QUEUE_FULL]++;
+
+		/* Have backends send its statement again */
+		if (otel_CheckLogMessage(&m, message, size))
+			otel_ForgetStatement(exporter->statementsSent,
+								 otel_SentStatementKey(exporter, &m, message));
+	}
+	else if (!otel_CheckLogMessage(&m, message, size))
+	{
+		batch->dropped++;
+		exporter->stats.dropped[PG_OTEL_LOGS_DROPPED_INVALID]++;
+	}
+	else if (otel_RepeatLogMessage(exporter, &m, message, size))
+	{
+		otel_RememberStatement(exporter, &m, message);
+		exporter->stats.collapsed++;
+	}
+	else
+	{
+		struct otelEncoder e = { .out = NULL, .size = 0 };
+		const struct otelLogsStatement *statement;
+		size_t length, resourceSize = 0;
+
+		otel_RememberStatement(exporter, &m, message);
+		statement = otel_FindStatement(exporter, &m);
+
+		otel_EncodeLogRecord(&e, &m, message, statement, exporter->attributeCountLimit);
+		length = e.size;
+		resource = llast(batch->resourceLogs);
+
+		/* Drop a record that cannot fit in any request */
+		if (otel_LogsResourceSize(exporter, exporter->packedResource) +
+			otel_LengthSize(length) > exporter->requestMax)
+		{
+			batch->dropped++;
+			exporter->stats.dropped[PG_OTEL_LOGS_DROPPED_OVERSIZED]++;
+			otel_ForgetStatement(exporter->statementsSent,
+								 otel_SentStatementKey(exporter, &m, message));
+			return;
+		}
+
+		/* Records that arrive after a reload go with the newer resource */
+		if (resource->packed != exporter->packedResource)
+			resourceSize = otel_LogsResourceSize(exporter, exporter->packedResource);
+
+		/* Close this batch when it has as many records or bytes as allowed */
+		if (batch->length >= batch->capacity ||
+			batch->size + resourceSize + otel_LengthSize(length) > exporter->requestMax)
+			batch = otel_AddLogsBatch(exporter);
+		else if (resourceSize > 0)
+			otel_AddLogsResource(exporter, batch);
+
+		resource = llast(batch->resourceLogs);
+
+		record = &batch->records[batch->length];
+		record->size = otel_LengthSize(length);
+		record->data = MemoryContextAlloc(batch->context, record->size);
+		record->statementKey = otel_SentStatementKey(exporter, &m, message);
+
+		e.out = record->data;
+		e.size = 0;
+		otel_EncodeLength(&e, OTEL_WIRE_TAG(2, OTEL_WIRE_LEN), length);
+		otel_EncodeLogRecord(&e, &m, message, statement, exporter->attributeCountLimit);
+		Assert(e.size == record->size);
+
+		/* Send this batch when it is full or this record has waited long enough */
+		if (batch->length == 0)
+			batch->deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+														  exporter->scheduleDelayMS);
+
+		batch->length++;
+		batch->size += record->size;
+		exporter->queueLength++;
+
+		resource->length++;
+		resource->recordsSize += record->size;
+	}
+}
+
+/*
+ * Allocate a batch in its own top-level context and append it to exporter's queue.
+ */
+static struct otelLogsBatch *
+otel_AddLogsBatch(struct otelLogsExporter *exporter)
+{
+	MemoryContext ctx = AllocSetContextCreate(NULL, /* parent */
+											  PG_OTEL_LIBRARY " logs batch",
+											  ALLOCSET_START_SMALL_SIZES);
+	struct otelLogsBatch *batch = MemoryContextAllocZero(ctx, sizeof(*batch));
+
+	batch->capacity = exporter->batchMax;
+	batch->context = ctx;
+	batch->signal = PG_OTEL_CONFIG_LOGS;
+	batch->records = MemoryContextAlloc(batch->context,
+										sizeof(*(batch->records)) *
+										batch->capacity);
+
+	otel_AddLogsResource(exporter, batch);
+
+	dlist_push_tail(&exporter->queue, &batch->list_node);
+
+	return batch;
+}
+
+/* Called when the last memory context that shares packed is freed */
+static void
+otel_ReleasePackedResource(void *arg)
+{
+	struct otelPackedResource *packed = arg;
+
+	Assert(packed->refs > 0);
+
+	if (--packed->refs == 0)
+	{
+		pfree(packed->data);
+		pfree(packed);
+	}
+}
+
+/*
+ * Share packed with everything in context. It stays allocated until context
+ * is freed.
+ */
+static void
+otel_RetainPackedResource(struct otelPackedResource *packed, MemoryContext context)
+{
+	MemoryContextCallback *callback =
+		MemoryContextAlloc(context, sizeof(MemoryContextCallback));
+
+	callback->func = otel_ReleasePackedResource;
+	callback->arg = packed;
+	MemoryContextRegisterResetCallback(context, callback);
+	packed->refs++;
+}
+
+/*
+ * Encode the exporter's resource once for the configuration that was just
+ * loaded. Batches that refer to the previous one keep it.
+ */
+static void
+otel_PackLogsResource(struct otelLogsExporter *exporter)
+{
+	const struct otelResource *resource = &exporter->resource;
+	struct otelPackedResource *packed =
+		MemoryContextAlloc(TopMemoryContext, sizeof(*packed));
+
+	packed->size = OTEL_FUNC_RESOURCE(resource__get_packed_size)(&resource->resource);
+	packed->data = MemoryContextAlloc(TopMemoryContext, packed->size);
+	packed->size = OTEL_FUNC_RESOURCE(resource__pack)(&resource->resource, packed->data);
+	packed->refs = 1;
+
+	if (exporter->packedResource != NULL)
+		otel_ReleasePackedResource(exporter->packedResource);
+
+	exporter->packedResource = packed;
+}
+
+/*
+ * Store the exporter's encoded resource in batch to be exported with any
+ * following records.
+ */
+static void
+otel_AddLogsResource(struct otelLogsExporter *exporter, struct otelLogsBatch *batch)
+{
+	struct otelLogsResource *next =
+		MemoryContextAllocZero(batch->context, sizeof(*next));
+	MemoryContext previous;
+
+	next->packed = exporter->packedResource;
+	next->offset = batch->length;
+	next->length = 0;
+	next->recordsSize = 0;
+	otel_RetainPackedResource(next->packed, batch->context);
+
+	previous = MemoryContextSwitchTo(batch->context);
+	batch->resourceLogs = lappend(batch->resourceLogs, next);
+	batch->size += otel_LogsResourceSize(exporter, next->packed);
+	MemoryContextSwitchTo(previous);
+}
+
+/*
+ * The encoded size of a resource and its framing in a request, not including
+ * its records. See otel_PrepareLogsRequest.
+ */
+static size_t
+otel_LogsResourceSize(const struct otelLogsExporter *exporter,
+					  const struct otelPackedResource *packed)
+{
+	/* Three tags and lengths; each varint is at most 10 bytes */
+	return 3 * 11 + packed->size + exporter->scopeSize +
+		2 * exporter->schemaURLSize;
+}
+
+/*
+ * Move the second half of the records in batch to a new batch that follows it
+ * in the queue. The records and resources are copied so that each batch can be
+ * freed on its own.
+ */
+static void
+otel_SplitLogsBatch(struct otelLogsExporter *exporter, struct otelLogsBatch *batch)
+{
+	MemoryContext ctx = AllocSetContextCreate(NULL, /* parent */
+											  PG_OTEL_LIBRARY " logs batch",
+											  ALLOCSET_START_SMALL_SIZES);
+	MemoryContext previous = MemoryContextSwitchTo(ctx);
+	struct otelLogsBatch *next = palloc0(sizeof(*next));
+	const int half = batch->length / 2;
+	List *kept = NIL;
+	ListCell *cell;
+
+	next->capacity = batch->capacity;
+	next->context = ctx;
+	next->deadline = batch->deadline;
+	next->signal = batch->signal;
+	next->records = palloc(sizeof(*(next->records)) * next->capacity);
+
+	foreach(cell, batch->resourceLogs)
+	{
+		struct otelLogsResource *resource = lfirst(cell);
+		struct otelLogsResource *copy;
+		int start = Max(resource->offset, half);
+		int end = resource->offset + resource->length;
+
+		/* Records that arrive later belong to the last resource */
+		if (end <= half && resource != llast(batch->resourceLogs))
+			continue;
+
+		copy = palloc0(sizeof(*copy));
+		copy->packed = resource->packed;
+		copy->offset = next->length;
+		otel_RetainPackedResource(copy->packed, ctx);
+
+		for (int i = start; i < end; i++)
+		{
+			struct otelLogsRecord *record = &next->records[next->length++];
+
+			record->size = batch->records[i].size;
+			record->data = palloc(record->size);
+			record->statementKey = batch->records[i].statementKey;
+			memcpy(record->data, batch->records[i].data, record->size);
+
+			copy->length++;
+			copy->recordsSize += record->size;
+		}
+
+		next->resourceLogs = lappend(next->resourceLogs, copy);
+		next->size += otel_LogsResourceSize(exporter, copy->packed) + copy->recordsSize;
+
+		resource->length -= copy->length;
+		resource->recordsSize -= copy->recordsSize;
+	}
+
+	/* Keep the resources that still have records */
+	MemoryContextSwitchTo(batch->context);
+	batch->length = half;
+	batch->size = 0;
+
+	foreach(cell, batch->resourceLogs)
+	{
+		struct otelLogsResource *resource = lfirst(cell);
+
+		if (resource->length > 0)
+		{
+			kept = lappend(kept, resource);
+			batch->size += otel_LogsResourceSize(exporter, resource->packed) +
+				resource->recordsSize;
+		}
+	}
+	batch->resourceLogs = kept;
+
+	MemoryContextSwitchTo(previous);
+
+	dlist_insert_after(&batch->list_node, &next->list_node);
+}
+
+/* Append size bytes at data to the pieces of body */
+static void
+otel_AddBodyPiece(struct otelRequestBody *body, const uint8_t *data, size_t size)
+{
+	Assert(body->length < body->capacity);
+
+	body->pieces[body->length].data = data;
+	body->pieces[body->length].size = size;
+	body->length++;
+	body->size += size;
+}
+
+/*
+ * Prepare body to stream an ExportLogsServiceRequest containing every record
+ * in batch. Everything around the records is either precomputed or a few
+ * bytes of framing, and the records themselves are read where they are.
+ */
+static void
+otel_PrepareLogsRequest(struct otelRequestBody *body,
+						const struct otelLogsExporter *exporter,
+						const struct otelLogsBatch *batch)
+{
+	ListCell *cell;
+
+	body->capacity = 1 + batch->length + 6 * list_length(batch->resourceLogs);
+	body->pieces = MemoryContextAlloc(batch->context,
+									  sizeof(*(body->pieces)) * body->capacity);
+	body->length = 0;
+	body->size = 0;
+	body->piece = 0;
+	body->offset = 0;
+	body->deflate = NULL;
+	body->deflated = false;
+	body->threaded = false;
+
+	/* A request from disk is already encoded */
+	if (batch->request != NULL)
+	{
+		otel_AddBodyPiece(body, batch->request, batch->size);
+		return;
+	}
+
+	foreach(cell, batch->resourceLogs)
+	{
+		const struct otelLogsResource *resource = lfirst(cell);
+		size_t scopeLogsSize =
+			exporter->scopeSize + resource->recordsSize + exporter->schemaURLSize;
+		size_t resourceLogsSize =
+			otel_LengthSize(resource->packed->size) + otel_LengthSize(scopeLogsSize) +
+			exporter->schemaURLSize;
+		size_t start;
+
+		/* Three tags and lengths; each varint is at most 10 bytes */
+		struct otelEncoder framing = {
+			.out = MemoryContextAlloc(batch->context, 3 * 11),
+			.size = 0,
+		};
+
+		otel_EncodeLength(&framing, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN), resourceLogsSize);
+		otel_EncodeLength(&framing, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN), resource->packed->size);
+		otel_AddBodyPiece(body, framing.out, framing.size);
+		otel_AddBodyPiece(body, resource->packed->data, resource->packed->size);
+
+		start = framing.size;
+		otel_EncodeLength(&framing, OTEL_WIRE_TAG(2, OTEL_WIRE_LEN), scopeLogsSize);
+		otel_AddBodyPiece(body, framing.out + start, framing.size - start);
+		otel_AddBodyPiece(body, exporter->scope, exporter->scopeSize);
+
+		for (int i = resource->offset; i < resource->offset + resource->length; i++)
+			otel_AddBodyPiece(body, batch->records[i].data, batch->records[i].size);
+
+		otel_AddBodyPiece(body, exporter->schemaURL, exporter->schemaURLSize);
+		otel_AddBodyPiece(body, exporter->schemaURL, exporter->schemaURLSize);
+	}
+}
+
+/*
+ * Write the oldest batch in the queue to disk and free it. This returns false
+ * when it is not written.
+ */
+static bool
+otel_SpillLogsBatch(struct otelLogsExporter *exporter)
+{
+	struct otelLogsBatch *batch;
+	struct otelRequestBody body;
+
+	if (dlist_is_empty(&exporter->queue) || exporter->spill.sizeMax == 0)
+		return false;
+
+	batch = dlist_head_element(struct otelLogsBatch, list_node,
+							   &exporter->queue);
+
+	if (batch->length == 0)
+		return false;
+
+	otel_PrepareLogsRequest(&body, exporter, batch);
+
+	if (!otel_SpillWrite(&exporter->spill, &body, batch->length))
+		return false;
+
+	dlist_delete(&batch->list_node);
+	exporter->queueLength -= batch->length;
+	MemoryContextDelete(batch->context);
+	return true;
+}
+
+/*
+ * Read the oldest request on disk into a batch of its own. This returns NULL
+ * when there is nothing on disk.
+ */
+static struct otelLogsBatch *
+otel_ReplayLogsBatch(struct otelLogsExporter *exporter)
+{
+	MemoryContext ctx = AllocSetContextCreate(NULL, /* parent */
+											  PG_OTEL_LIBRARY " logs batch",
+											  ALLOCSET_START_SMALL_SIZES);
+	struct otelLogsBatch *batch = MemoryContextAllocZero(ctx, sizeof(*batch));
+
+	batch->context = ctx;
+	batch->request = otel_SpillRead(&exporter->spill, ctx,
+									&batch->size, &batch->requestLength);
+	batch->signal = PG_OTEL_CONFIG_LOGS;
+	batch->spilled = true;
+
+	if (batch->request == NULL)
+	{
+		MemoryContextDelete(ctx);
+		return NULL;
+	}
+
+	return batch;
+}
+
+/*
+ * Copy the next bytes of a request body into buffer, as needed by
+ * [CURLOPT_READFUNCTION]. Returns zero at the end of the body.
+ */
+static size_t
+otel_ReadRequestBody(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+	struct otelRequestBody *body = userdata;
+	size_t written = 0, want = size * nitems;
+
+	while (written < want && body->piece < body->length)
+	{
+		size_t available = body->pieces[body->piece].size - body->offset;
+		size_t n = Min(available, want - written);
+
+		memcpy(buffer + written, body->pieces[body->piece].data + body->offset, n);
+		written += n;
+		body->offset += n;
+
+		if (body->offset == body->pieces[body->piece].size)
+		{
+			body->piece++;
+			body->offset = 0;
+		}
+	}
+
+	return written;
+}
+
+/*
+ * Compress the next bytes of a request body into buffer, as needed by
+ * [CURLOPT_READFUNCTION]. Returns zero at the end of the compressed body.
+ */
+static size_t
+otel_ReadDeflatedRequestBody(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+	struct otelRequestBody *body = userdata;
+	z_stream *z = body->deflate;
+
+	z->next_out = (Bytef *) buffer;
+	z->avail_out = size * nitems;
+
+	/* Only the worker itself reports wait events */
+	if (!body->threaded)
+		pgstat_report_wait_start(otel_WaitEvents.compress);
+	while (z->avail_out > 0 && !body->deflated)
+	{
+		int flush = Z_NO_FLUSH;
+		int result;
+
+		/* Give zlib the next piece when it has finished the last one */
+		if (z->avail_in == 0 && body->piece < body->length)
+		{
+			z->next_in = (Bytef *) body->pieces[body->piece].data;
+			z->avail_in = body->pieces[body->piece].size;
+			body->piece++;
+		}
+
+		if (z->avail_in == 0 && body->piece == body->length)
+			flush = Z_FINISH;
+
+		result = deflate(z, flush);
+
+		if (result == Z_STREAM_END)
+			body->deflated = true;
+		else if (result != Z_OK && result != Z_BUF_ERROR)
+		{
+			if (!body->threaded)
+				pgstat_report_wait_end();
+			return CURL_READFUNC_ABORT;
+		}
+	}
+	if (!body->threaded)
+		pgstat_report_wait_end();
+
+	return size * nitems - z->avail_out;
+}
+
+/*
+ * Move the read position of a request body, as needed by
+ * [CURLOPT_SEEKFUNCTION]. Curl does this to send the body again after
+ * a redirect or authentication.
+ */
+static int
+otel_SeekRequestBody(void *userdata, curl_off_t offset, int origin)
+{
+	struct otelRequestBody *body = userdata;
+
+	if (origin != SEEK_SET || offset < 0 || (size_t) offset > body->size)
+		return CURL_SEEKFUNC_CANTSEEK;
+
+	body->piece = 0;
+	body->offset = 0;
+
+	/* A compressed body can only start over */
+	if (body->deflate != NULL)
+	{
+		if (offset != 0 || deflateReset(body->deflate) != Z_OK)
+			return CURL_SEEKFUNC_CANTSEEK;
+
+		/* Forget any input from before, so it begins again with the first piece */
+		body->deflate->avail_in = 0;
+		body->deflate->next_in = NULL;
+		body->deflated = false;
+		return CURL_SEEKFUNC_OK;
+	}
+
+	while (body->piece < body->length &&
+		   (size_t) offset >= body->pieces[body->piece].size)
+	{
+		offset -= body->pieces[body->piece].size;
+		body->piece++;
+	}
+
+	body->offset = offset;
+	return CURL_SEEKFUNC_OK;
+}
+
+/*
+ * Called by curl for each header and trailer of a response. This keeps the
+ * status of a gRPC call, as needed by [CURLOPT_HEADERFUNCTION].
+ */
+static size_t
+otel_ReadResponseHeader(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+	struct otelLogsExport *export = userdata;
+	size_t length = size * nitems;
+
+	/* Every line ends with CRLF, so these stop before the end of buffer */
+	if (length > 12 && pg_strncasecmp(buffer, "grpc-status:", 12) == 0)
+		export->grpcStatus = atoi(buffer + 12);
+
+	else if (length > 13 && pg_strncasecmp(buffer, "grpc-message:", 13) == 0)
+	{
+		size_t start = 13, end = length;
+
+		while (start < end && buffer[start] == ' ')
+			start++;
+		while (end > start && (buffer[end - 1] == '\r' || buffer[end - 1] == '\n'))
+			end--;
+
+		end = Min(end, start + sizeof(export->grpcMessage) - 1);
+		memcpy(export->grpcMessage, buffer + start, end - start);
+		export->grpcMessage[end - start] = '\0';
+	}
+
+	return length;
+}
+
+/*
+ * Called by curl with the body of a response, as needed by
+ * [CURLOPT_WRITEFUNCTION]. Nothing in it is used.
+ */
+static size_t
+otel_DiscardResponseBody(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	return size * nmemb;
+}
+
+/*
+ * Prepare the curl handle of export to stream its body to the collector
+ * configured in exporter.
+ */
+static void
+otel_SetLogsExportOptions(struct otelLogsExporter *exporter,
+						  struct otelLogsExport *export)
+{
+	CURL *http = export->http;
+	struct otelRequestBody *body = &export->body;
+	struct curl_slist *headers = NULL;
+
+	/*
+	 * These do not error or their error can be ignored. Every option is set
+	 * on every request rather than reset, so nothing from the previous request
+	 * carries over and the connection stays in the multi handle for reuse.
+	 */
+	curl_easy_setopt(http, CURLOPT_PRIVATE, export);
+	curl_easy_setopt(http, CURLOPT_ERRORBUFFER, export->httpErrorBuffer);
+	curl_easy_setopt(http, CURLOPT_CONNECTTIMEOUT_MS, 1 + (exporter->timeoutMS / 2));
+	curl_easy_setopt(http, CURLOPT_TIMEOUT_MS, exporter->timeoutMS);
+	curl_easy_setopt(http, CURLOPT_USERAGENT, PG_OTEL_USERAGENT);
+
+	curl_easy_setopt(http, CURLOPT_SSL_VERIFYHOST, exporter->insecure ? 0 : 2);
+	curl_easy_setopt(http, CURLOPT_SSL_VERIFYPEER, exporter->insecure ? 0 : 1);
+
+	/*
+	 * Negotiate HTTP/2 with ALPN over TLS, but assume it without TLS. Wait for
+	 * an existing connection rather than opening another so that concurrent
+	 * exports are multiplexed on it.
+	 */
+	if (!exporter->http2)
+		curl_easy_setopt(http, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+	else if (pg_strncasecmp(exporter->endpoint, "https:", 6) == 0)
+		curl_easy_setopt(http, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+	else
+		curl_easy_setopt(http, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+
+	curl_easy_setopt(http, CURLOPT_PIPEWAIT, exporter->http2 ? 1L : 0L);
+
+	/* TODO: check errors */
+	curl_easy_setopt(http, CURLOPT_URL,
+					 (export->batch->signal == PG_OTEL_CONFIG_METRICS) ?
+					 exporter->metricsEndpoint : exporter->endpoint);
+
+	/* TODO: check errors */
+	if (exporter->protocol == PG_OTEL_CONFIG_PROTOCOL_GRPC)
+	{
+		/*
+		 * gRPC sends its status in trailers. Its compression is indicated in
+		 * the message prefix.
+		 * - https://github.com/grpc/grpc/blob/master/doc/PROTOCOL-HTTP2.md
+		 */
+		headers = curl_slist_append(headers, PG_OTEL_HEADER_GRPC);
+		headers = curl_slist_append(headers, "TE: trailers");
+
+		if (export->grpcPrefix[0] != 0)
+			headers = curl_slist_append(headers, "grpc-encoding: gzip");
+	}
+	else
+		headers = curl_slist_append(headers, PG_OTEL_HEADER_PROTOBUF);
+
+	/* Send the body without waiting for "100 Continue" */
+	headers = curl_slist_append(headers, "Expect:");
+
+	if (body->deflate != NULL)
+		headers = curl_slist_append(headers, "Content-Encoding: gzip");
+
+	curl_easy_setopt(http, CURLOPT_HTTPHEADER, headers);
+
+	/* Look for a gRPC status and ignore the response body */
+	export->grpcStatus = -1;
+	export->grpcMessage[0] = '\0';
+	curl_easy_setopt(http, CURLOPT_HEADERFUNCTION, otel_ReadResponseHeader);
+	curl_easy_setopt(http, CURLOPT_HEADERDATA, export);
+	curl_easy_setopt(http, CURLOPT_WRITEFUNCTION, otel_DiscardResponseBody);
+
+	/*
+	 * TODO: retry and backoff
+	 * - https://opentelemetry.io/docs/reference/specification/protocol/otlp/
+	 * - https://opentelemetry.io/docs/reference/specification/protocol/exporter/
+	 */
+
+#ifdef PG_OTEL_DEBUG
+	/* Print debugging information to stderr; off by default */
+	curl_easy_setopt(http, CURLOPT_VERBOSE, 1);
+#endif
+
+	/*
+	 * Curl reads the body as it sends, so there is never a copy of the entire
+	 * request in memory. The length of a compressed body is not known ahead
+	 * of time, so curl sends it in chunks.
+	 */
+	curl_easy_setopt(http, CURLOPT_POST, 1);
+	curl_easy_setopt(http, CURLOPT_READDATA, body);
+	curl_easy_setopt(http, CURLOPT_SEEKFUNCTION, otel_SeekRequestBody);
+	curl_easy_setopt(http, CURLOPT_SEEKDATA, body);
+
+	if (body->deflate != NULL)
+	{
+		curl_easy_setopt(http, CURLOPT_READFUNCTION, otel_ReadDeflatedRequestBody);
+		curl_easy_setopt(http, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) -1);
+	}
+	else
+	{
+		curl_easy_setopt(http, CURLOPT_READFUNCTION, otel_ReadRequestBody);
+		curl_easy_setopt(http, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) body->size);
+	}
+
+	export->headers = headers;
+}
+
+/*
+ * Return the gzip stream of export ready for a new request, or NULL when it
+ * cannot be used. The stream is allocated once and reset for each request.
+ */
+static z_stream *
+otel_ResetLogsDeflate(struct otelLogsExporter *exporter,
+					  struct otelLogsExport *export)
+{
+	z_stream *z = &export->deflate;
+
+	if (!export->deflateReady)
+	{
+		z->zalloc = Z_NULL;
+		z->zfree = Z_NULL;
+		z->opaque = Z_NULL;
+
+		/* Sixteen more window bits writes a gzip header and trailer */
+		if (deflateInit2(z, exporter->compressionLevel, Z_DEFLATED,
+						 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			ereport(WARNING,
+					(errmsg("could not initialize otel compression: %s",
+							z->msg != NULL ? z->msg : "out of memory")));
+			return NULL;
+		}
+
+		export->deflateReady = true;
+		return z;
+	}
+
+	/* The level may have changed since the last request */
+	if (deflateReset(z) != Z_OK ||
+		deflateParams(z, exporter->compressionLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		deflateEnd(z);
+		export->deflateReady = false;
+		return NULL;
+	}
+
+	return z;
+}
+
+/*
+ * Deflate the pieces of message into body, in pieces of a fixed size as they
+ * fill. Return false when zlib fails or the pieces of body run out; the caller
+ * sends the message uncompressed instead.
+ */
+static bool
+otel_DeflateGRPCMessage(struct otelRequestBody *body, z_stream *z,
+						const struct otelRequestBody *message,
+						MemoryContext context)
+{
+	z->next_out = Z_NULL;
+	z->avail_out = 0;
+
+	for (int i = 0; i <= message->length; i++)
+	{
+		bool finish = (i == message->length);
+
+		z->next_in = finish ? Z_NULL : (Bytef *) message->pieces[i].data;
+		z->avail_in = finish ? 0 : message->pieces[i].size;
+
+		while (finish || z->avail_in > 0)
+		{
+			uInt avail;
+			int  rc;
+
+			if (z->avail_out == 0)
+			{
+				if (body->length >= body->capacity)
+					return false;
+
+				z->next_out = MemoryContextAlloc(context, PG_OTEL_GRPC_DEFLATE_PIECE);
+				z->avail_out = PG_OTEL_GRPC_DEFLATE_PIECE;
+				otel_AddBodyPiece(body, z->next_out, 0);
+			}
+
+			avail = z->avail_out;
+			rc = deflate(z, finish ? Z_FINISH : Z_NO_FLUSH);
+			body->pieces[body->length - 1].size += avail - z->avail_out;
+			body->size += avail - z->avail_out;
+
+			if (finish && rc == Z_STREAM_END)
+				return true;
+
+			/*
+			 * There is always input or room for output here, so anything but
+			 * progress is an error, including Z_BUF_ERROR.
+			 */
+			if (rc != Z_OK)
+				return false;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Wrap the body of export in a gRPC message. gRPC compresses each message on
+ * its own and the message length comes first, so a compressed message is
+ * deflated entirely and held in memory before it is sent. It goes into pieces
+ * of a fixed size so that only about its compressed size is allocated.
+ * - https://github.com/grpc/grpc/blob/master/doc/PROTOCOL-HTTP2.md
+ */
+static void
+otel_FrameGRPCRequest(struct otelLogsExporter *exporter,
+					  struct otelLogsExport *export)
+{
+	struct otelRequestBody *body = &export->body;
+	struct otelRequestBody message = *body;
+	uint8_t *prefix = export->grpcPrefix;
+	bool deflated = false;
+	size_t size;
+	z_stream *z = NULL;
+
+	/* Put the prefix before the message */
+	body->capacity = 1 + message.length;
+
+	if (exporter->compression == PG_OTEL_CONFIG_COMPRESSION_GZIP &&
+		(z = otel_ResetLogsDeflate(exporter, export)) != NULL)
+	{
+		uLong pieces = deflateBound(z, message.size) / PG_OTEL_GRPC_DEFLATE_PIECE + 1;
+
+		body->capacity = Max(body->capacity, 1 + pieces);
+	}
+
+	body->pieces = MemoryContextAlloc(export->batch->context,
+									  sizeof(*(body->pieces)) * body->capacity);
+	body->length = 0;
+	body->size = 0;
+	otel_AddBodyPiece(body, prefix, sizeof(export->grpcPrefix));
+
+	if (z != NULL)
+	{
+		pgstat_report_wait_start(otel_WaitEvents.compress);
+		deflated = otel_DeflateGRPCMessage(body, z, &message,
+										   export->batch->context);
+		pgstat_report_wait_end();
+	}
+
+	/* Send it uncompressed if something went wrong */
+	if (!deflated)
+	{
+		body->length = 1;
+		body->size = sizeof(export->grpcPrefix);
+		memcpy(body->pieces + 1, message.pieces,
+			   sizeof(*(body->pieces)) * message.length);
+		body->length += message.length;
+		body->size += message.size;
+	}
+
+	size = body->size - sizeof(export->grpcPrefix);
+	prefix[0] = deflated ? 1 : 0;
+	prefix[1] = (size >> 24) & 0xFF;
+	prefix[2] = (size >> 16) & 0xFF;
+	prefix[3] = (size >> 8) & 0xFF;
+	prefix[4] = size & 0xFF;
+}
+
+/*
+ * Return an idle export of exporter, or NULL when it has as many in flight as
+ * it is allowed.
+ */
+static struct otelLogsExport *
+otel_IdleLogsExport(struct otelLogsExporter *exporter)
+{
+	struct otelLogsExport *export;
+	dlist_iter iter;
+
+	if (exporter->exportsLength >= exporter->exportsMax)
+		return NULL;
+
+	dlist_foreach(iter, &exporter->exports)
+	{
+		export = dlist_container(struct otelLogsExport, list_node, iter.cur);
+		if (export->batch == NULL)
+			return export;
+	}
+
+	export = MemoryContextAllocZero(TopMemoryContext, sizeof(*export));
+	export->http = curl_easy_init();
+
+	if (export->http == NULL)
+	{
+		pfree(export);
+		ereport(WARNING, (errmsg("could not initialize curl for otel exporter")));
+		return NULL;
+	}
+
+	dlist_push_tail(&exporter->exports, &export->list_node);
+	return export;
+}
+
+/*
+ * Called by the background worker to find when the next batch should be
+ * sent. Returns false when there is nothing that could be sent.
+ */
+static bool
+otel_LogsExportDeadline(struct otelLogsExporter *exporter, TimestampTz *deadline)
+{
+	bool due = false;
+
+	*deadline = 0;
+
+	if (exporter->exportsLength >= exporter->exportsMax)
+		return false;
+
+	/* Only one export is in flight while exports are failing */
+	if (exporter->failing && exporter->exportsLength > 0)
+		return false;
+
+	if (!dlist_is_empty(&exporter->queue))
+	{
+		struct otelLogsBatch *batch =
+			dlist_head_element(struct otelLogsBatch, list_node, &exporter->queue);
+
+		/* A full batch should be sent right away */
+		if (batch->length > 0)
+		{
+			due = true;
+			*deadline = (batch->length < batch->capacity) ? batch->deadline : 0;
+		}
+	}
+
+	/* Metrics are sent right away */
+	if (exporter->metrics != NULL)
+	{
+		due = true;
+		*deadline = 0;
+	}
+
+	/* Requests on disk are tried again along with everything else */
+	if (exporter->failing)
+	{
+		if (!exporter->spill.reading && otel_SpillPending(&exporter->spill))
+		{
+			due = true;
+			*deadline = 0;
+		}
+
+		*deadline = Max(*deadline, exporter->retryAt);
+	}
+
+	return due;
+}
+
+/*
+ * Called by the background worker to start sending batches to the collector.
+ * They are sent by multi without waiting, as many at a time as configured.
+ * A batch is sent when it is full, when its deadline has passed, or when
+ * flush is true.
+ */
+static void
+otel_StartLogsExports(struct otelLogsExporter *exporter, CURLM *multi, bool flush)
+{
+	TimestampTz now = GetCurrentTimestamp();
 
 	/*
-	 * Per-signal URLs MUST be used as-is without any modification. When there
-	 * is no path, append the root path.
-	 *
-	 * Without a per-signal configuration, the OTLP endpoint is a base URL and
-	 * signals are sent relative to that.
-	 *
-	 * - https://opentelemetry.io/docs/reference/specification/protocol/exporter/
+	 * Multiplex HTTP/2 streams when possible, no more at once than the number
+	 * of concurrent exports.
 	 */
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING,
+					  exporter->http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#if LIBCURL_VERSION_NUM >= 0x074300 /* 7.67.0 */
+	curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+					  (long) exporter->exportsMax);
+#endif
+
+	otel_FlushRepeatedLogs(exporter, flush);
+
+	/* When stopping while exports are failing, keep what fits on disk */
+	if (flush && exporter->failing)
+		while (otel_SpillLogsBatch(exporter))
+			continue;
+
+	for (;;)
 	{
-		StringInfoData str;
+		struct otelLogsBatch *batch = NULL;
+		struct otelLogsExport *export;
+		bool metrics, replay;
+
+		/*
+		 * While exports are failing, send one at a time after a delay until
+		 * one succeeds. Batches that wait too long are moved to disk.
+		 */
+		if (!flush && exporter->failing &&
+			(exporter->exportsLength > 0 || now < exporter->retryAt))
+			break;
 
-		Assert(config->otlpLogs.endpoint == NULL); /* TODO: per-signal */
+		/* Metrics go first; they are few */
+		metrics = (exporter->metrics != NULL);
+
+		if (!metrics && !dlist_is_empty(&exporter->queue))
+		{
+			batch = dlist_head_element(struct otelLogsBatch, list_node,
+									   &exporter->queue);
+
+			/* Nothing to send, or wait for more records */
+			if (batch->length == 0 ||
+				(!flush && batch->length < batch->capacity && now < batch->deadline))
+				batch = NULL;
+		}
+
+		/*
+		 * Otherwise, send requests from disk one at a time, oldest first. They
+		 * are left there when stopping.
+		 */
+		replay = (!metrics && batch == NULL && !flush &&
+				  !exporter->spill.reading && otel_SpillPending(&exporter->spill));
+
+		if (!metrics && batch == NULL && !replay)
+			break;
+
+		if ((export = otel_IdleLogsExport(exporter)) == NULL)
+			break;
+
+		if (metrics)
+		{
+			batch = exporter->metrics;
+			exporter->metrics = NULL;
+		}
+		else if (replay)
+		{
+			if ((batch = otel_ReplayLogsBatch(exporter)) == NULL)
+				break;
+		}
+		else
+		{
+			/* Send at most requestMax bytes; the limit may have been lowered */
+			while (batch->size > exporter->requestMax && batch->length > 1)
+				otel_SplitLogsBatch(exporter, batch);
+
+			dlist_pop_head_node(&exporter->queue);
+		}
+
+		export->batch = batch;
+		otel_PrepareLogsRequest(&export->body, exporter, batch);
+
+		if (exporter->protocol == PG_OTEL_CONFIG_PROTOCOL_GRPC)
+			otel_FrameGRPCRequest(exporter, export);
+		else if (exporter->compression == PG_OTEL_CONFIG_COMPRESSION_GZIP)
+			export->body.deflate = otel_ResetLogsDeflate(exporter, export);
+
+		/* A pipeline compresses and sends on its own thread */
+		export->body.threaded = (exporter->pipeline != NULL);
+		otel_SetLogsExportOptions(exporter, export);
+
+		if (!export->body.threaded ||
+			!otel_PipelineSubmit(exporter->pipeline, export,
+								 exporter->http2, exporter->exportsMax))
+		{
+			CURLMcode code;
+
+			export->body.threaded = false;
+			if ((code = curl_multi_add_handle(multi, export->http)) != CURLM_OK)
+			{
+				ereport(WARNING,
+						(errmsg("otel exporter could not start a request: %s",
+								curl_multi_strerror(code))));
+
+				/*
+				 * Put the batch back where it came from and leave the export
+				 * idle. The next call tries again.
+				 */
+				curl_slist_free_all(export->headers);
+				export->headers = NULL;
+				export->batch = NULL;
+
+				if (metrics)
+					exporter->metrics = batch;
+				else if (replay)
+				{
+					otel_SpillRelease(&exporter->spill);
+					MemoryContextDelete(batch->context);
+				}
+				else
+					dlist_push_head(&exporter->queue, &batch->list_node);
+				break;
+			}
+		}
+		exporter->exportsLength++;
+	}
+}
+
+/* Set every counter in stats to zero; they are cumulative from now */
+static void
+otel_ResetLogsStats(struct otelLogsStats *stats)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	memset(stats, 0, sizeof(*stats));
+	stats->startUnixNano = tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+/* Count the bytes, duration, and status of a finished request */
+static void
+otel_CountLogsExport(struct otelLogsStats *stats, CURL *http, long status)
+{
+	double seconds = 0;
+	int i;
+
+#if LIBCURL_VERSION_NUM >= 0x073700 /* 7.55.0 */
+	curl_off_t sent = 0;
+
+	curl_easy_getinfo(http, CURLINFO_SIZE_UPLOAD_T, &sent);
+#else
+	double sent = 0;
+
+	curl_easy_getinfo(http, CURLINFO_SIZE_UPLOAD, &sent);
+#endif
+	curl_easy_getinfo(http, CURLINFO_TOTAL_TIME, &seconds);
+
+	stats->bytesSent += (uint64) sent;
+
+	/* Each bucket includes its upper bound */
+	for (i = 0; i < PG_OTEL_EXPORT_DURATION_BOUNDS; i++)
+		if (seconds <= otel_ExportDurationBounds[i])
+			break;
+
+	stats->durations[i]++;
+	stats->durationCount++;
+	stats->durationSum += seconds;
+
+	/* Statuses beyond the first few distinct ones are not counted */
+	for (i = 0; i < stats->statusesLength; i++)
+		if (stats->statuses[i].status == status)
+			break;
+
+	if (i == stats->statusesLength && i < PG_OTEL_EXPORT_STATUSES)
+	{
+		stats->statuses[i].status = status;
+		stats->statuses[i].count = 0;
+		stats->statusesLength++;
+	}
+	if (i < stats->statusesLength)
+		stats->statuses[i].count++;
+}
+
+/*
+ * Called by the background worker when multi has finished sending http, or
+ * with a NULL multi when a pipeline has. The batch it was sending is
+ * released, written to disk, or counted as dropped.
+ */
+static void
+otel_FinishLogsExport(struct otelLogsExporter *exporter, CURLM *multi,
+					  CURL *http, CURLcode result)
+{
+	struct otelLogsExport *export = NULL;
+	struct otelLogsBatch *batch;
+	long status = 0;
+	bool retry = false;
+	char error[CURL_ERROR_SIZE + 64] = "";
+
+	curl_easy_getinfo(http, CURLINFO_PRIVATE, (char **) &export);
+	Assert(export != NULL && export->http == http);
+	Assert(export->batch != NULL);
+
+	curl_easy_getinfo(http, CURLINFO_RESPONSE_CODE, &status);
+	otel_CountLogsExport(&exporter->stats, http, status);
+	if (multi != NULL)
+		curl_multi_remove_handle(multi, http);
+	curl_slist_free_all(export->headers);
+	export->headers = NULL;
+	batch = export->batch;
+
+	if (result != CURLE_OK)
+	{
+		retry = true;
+		strlcpy(error, export->httpErrorBuffer[0] != '\0' ?
+				export->httpErrorBuffer : curl_easy_strerror(result),
+				sizeof(error));
+	}
+	else if (status < 200 || status >= 300)
+	{
+		/*
+		 * Requests that fail for a transient reason can be sent again later.
+		 * - https://opentelemetry.io/docs/specs/otlp/#failures-1
+		 */
+		retry = (status == 429 || status == 502 ||
+				 status == 503 || status == 504);
+		snprintf(error, sizeof(error), "HTTP status %ld", status);
+	}
+	else if (exporter->protocol == PG_OTEL_CONFIG_PROTOCOL_GRPC &&
+			 export->grpcStatus != 0)
+	{
+		/*
+		 * A gRPC call can fail after a successful HTTP response. Some of its
+		 * status codes are transient.
+		 * - https://opentelemetry.io/docs/specs/otlp/#failures
+		 * - https://github.com/grpc/grpc/blob/master/doc/statuscodes.md
+		 */
+		switch (export->grpcStatus)
+		{
+			case 1:  /* CANCELLED */
+			case 4:  /* DEADLINE_EXCEEDED */
+			case 8:  /* RESOURCE_EXHAUSTED */
+			case 10: /* ABORTED */
+			case 11: /* OUT_OF_RANGE */
+			case 14: /* UNAVAILABLE */
+			case 15: /* DATA_LOSS */
+				retry = true;
+				break;
+			default:
+				retry = false;
+		}
+
+		if (export->grpcStatus < 0)
+			strlcpy(error, "response has no gRPC status", sizeof(error));
+		else
+			snprintf(error, sizeof(error), "gRPC status %d %s",
+					 export->grpcStatus, export->grpcMessage);
+	}
+
+	if (error[0] == '\0')
+		exporter->stats.lastSuccessAt = GetCurrentTimestamp();
+	else
+	{
+		exporter->stats.lastErrorAt = GetCurrentTimestamp();
+		strlcpy(exporter->stats.lastError, error, sizeof(exporter->stats.lastError));
+	}
+
+	if (batch->signal != PG_OTEL_CONFIG_LOGS)
+	{
+		/*
+		 * Metrics are not kept nor sent again; the next export has the same
+		 * and more. Their failures do not hold back logs.
+		 */
+		if (error[0] == '\0' && exporter->metricsFailing)
+			ereport(LOG, (errmsg("otel exporter is sending metrics again")));
+		if (error[0] != '\0' && !exporter->metricsFailing)
+			ereport(LOG,
+					(errmsg("otel exporter could not send metrics: %s", error)));
+
+		exporter->metricsFailing = (error[0] != '\0');
+	}
+	else if (error[0] == '\0')
+	{
+		if (exporter->failing)
+			ereport(LOG, (errmsg("otel exporter is sending logs again")));
+
+		exporter->failing = false;
+		exporter->retryDelayMS = 0;
+
+		if (batch->spilled)
+			otel_SpillConsume(&exporter->spill);
+
+		exporter->stats.exported += batch->length + batch->requestLength;
+		otel_SettleStatements(exporter, batch, true);
+	}
+	else
+	{
+		struct otelRequestBody body;
+
+		if (!exporter->failing || !retry)
+			ereport(LOG,
+					(errmsg("otel exporter could not send logs: %s", error)));
+
+		/* Wait longer after each transient failure, up to 30 seconds */
+		exporter->failing = retry;
+		exporter->retryDelayMS = !retry ? 0 :
+			Min(Max(1000, exporter->retryDelayMS * 2), 30 * 1000);
+		exporter->retryAt = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+														exporter->retryDelayMS);
+
+		/* Requests on disk are not compressed nor framed by the protocol */
+		if (batch->spilled && retry)
+			otel_SpillRelease(&exporter->spill);
+		else if (batch->spilled)
+		{
+			otel_SpillConsume(&exporter->spill);
+			exporter->stats.dropped[PG_OTEL_LOGS_DROPPED_EXPORT] += batch->requestLength;
+		}
+		else
+		{
+			if (retry)
+				otel_PrepareLogsRequest(&body, exporter, batch);
+
+			if (!retry || !otel_SpillWrite(&exporter->spill, &body, batch->length))
+			{
+				exporter->stats.dropped[PG_OTEL_LOGS_DROPPED_EXPORT] += batch->length;
+				otel_SettleStatements(exporter, batch, false);
+			}
+		}
+	}
+
+	exporter->exportsLength--;
+	exporter->queueLength -= export->batch->length;
+
+	MemoryContextDelete(export->batch->context);
+	export->batch = NULL;
+}
+
+static void
+otel_InitLogsExporter(struct otelLogsExporter *exporter,
+					  const struct otelConfiguration *config, int channel)
+{
+	dlist_init(&exporter->queue);
+	dlist_init(&exporter->exports);
+	dlist_init(&exporter->repeatsOrder);
+	dlist_init(&exporter->statementsOrder);
+	exporter->pipeline = NULL;
+	exporter->statementsSent = NULL;
+	exporter->endpoint = NULL;
+	exporter->metricsEndpoint = NULL;
+	exporter->metrics = NULL;
+	exporter->packedResource = NULL;
+	exporter->exportsLength = 0;
+	exporter->queueLength = 0;
+	exporter->failing = false;
+	exporter->metricsFailing = false;
+	exporter->retryDelayMS = 0;
+
+	/*
+	 * All log records come from the same instrumentation scope: this module.
+	 * Encode it once along with the schema URL that follows every ScopeLogs
+	 * and ResourceLogs.
+	 * - https://docs.opentelemetry.io/reference/specification/glossary/#instrumentation-scope
+	 */
+	{
+		struct otelEncoder e = { .out = exporter->scope, .size = 0 };
+
+		otel_EncodeLength(&e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+						  otel_LengthSize(sizeof(PG_OTEL_LIBRARY) - 1) +
+						  otel_LengthSize(sizeof(PG_OTEL_VERSION) - 1));
+		otel_EncodeString(&e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+						  PG_OTEL_LIBRARY, sizeof(PG_OTEL_LIBRARY) - 1);
+		otel_EncodeString(&e, OTEL_WIRE_TAG(2, OTEL_WIRE_LEN),
+						  PG_OTEL_VERSION, sizeof(PG_OTEL_VERSION) - 1);
+		exporter->scopeSize = e.size;
+		Assert(e.size <= sizeof(exporter->scope));
+
+		e.out = exporter->schemaURL;
+		e.size = 0;
+		otel_EncodeString(&e, OTEL_WIRE_TAG(3, OTEL_WIRE_LEN),
+						  PG_OTEL_SCHEMA, sizeof(PG_OTEL_SCHEMA) - 1);
+		exporter->schemaURLSize = e.size;
+		Assert(e.size <= sizeof(exporter->schemaURL));
+	}
 
-		initStringInfo(&str);
-		appendStringInfoString(&str, config->otlp.endpoint);
+	/* Recent log messages */
+	{
+		HASHCTL ctl = {
+			.keysize = sizeof(pg_crc32c),
+			.entrysize = sizeof(struct otelLogsRepeat),
+		};
+
+		exporter->repeatsContext =
+			AllocSetContextCreate(TopMemoryContext,
+								  PG_OTEL_LIBRARY " repeated logs",
+								  ALLOCSET_DEFAULT_SIZES);
+		ctl.hcxt = exporter->repeatsContext;
+		exporter->repeats =
+			hash_create(PG_OTEL_LIBRARY " repeated logs", 64, &ctl,
+						HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	/* Recent statements */
+	{
+		HASHCTL ctl = {
+			.keysize = sizeof(uint64),
+			.entrysize = sizeof(struct otelLogsStatement),
+		};
+
+		exporter->statementsContext =
+			AllocSetContextCreate(TopMemoryContext,
+								  PG_OTEL_LIBRARY " statements",
+								  ALLOCSET_DEFAULT_SIZES);
+		ctl.hcxt = exporter->statementsContext;
+		exporter->statements =
+			hash_create(PG_OTEL_LIBRARY " statements", 64, &ctl,
+						HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	otel_ResetLogsStats(&exporter->stats);
+	otel_InitResource(&exporter->resource);
+	otel_InitSpill(&exporter->spill, channel);
+	otel_LoadLogsConfig(exporter, config);
+}
+
+/*
+ * Called by the background worker to release what exporter holds outside of
+ * memory contexts.
+ */
+static void
+otel_CloseLogsExporter(struct otelLogsExporter *exporter)
+{
+	dlist_mutable_iter iter;
+
+	Assert(exporter->exportsLength == 0);
+
+	dlist_foreach_modify(iter, &exporter->exports)
+	{
+		struct otelLogsExport *export =
+			dlist_container(struct otelLogsExport, list_node, iter.cur);
+
+		dlist_delete(iter.cur);
+		curl_easy_cleanup(export->http);
+
+		if (export->deflateReady)
+			deflateEnd(&export->deflate);
+
+		pfree(export);
+	}
+
+	if (exporter->metrics != NULL)
+		MemoryContextDelete(exporter->metrics->context);
+	exporter->metrics = NULL;
+
+	hash_destroy(exporter->repeats);
+	MemoryContextDelete(exporter->repeatsContext);
+	exporter->repeats = NULL;
+	exporter->repeatsContext = NULL;
+	dlist_init(&exporter->repeatsOrder);
+
+	hash_destroy(exporter->statements);
+	MemoryContextDelete(exporter->statementsContext);
+	exporter->statements = NULL;
+	exporter->statementsContext = NULL;
+	dlist_init(&exporter->statementsOrder);
+
+	if (exporter->packedResource != NULL)
+		otel_ReleasePackedResource(exporter->packedResource);
+	exporter->packedResource = NULL;
+
+	otel_CloseSpill(&exporter->spill);
+}
+
+/*
+ * The URL to which one signal is sent.
+ *
+ * Per-signal URLs MUST be used as-is without any modification. When there
+ * is no path, append the root path.
+ *
+ * Without a per-signal configuration, the OTLP endpoint is a base URL and
+ * signals are sent relative to that.
+ *
+ * - https://opentelemetry.io/docs/reference/specification/protocol/exporter/
+ */
+static char *
+otel_SignalEndpoint(const struct otelConfiguration *config,
+					const char *path, const char *method)
+{
+	StringInfoData str;
+
+	initStringInfo(&str);
+	appendStringInfoString(&str, config->otlp.endpoint);
 
+	if (config->otlp.protocol == PG_OTEL_CONFIG_PROTOCOL_GRPC)
+	{
+		/*
+		 * gRPC calls a method at the scheme, host, and port of the
+		 * endpoint; any path there is ignored.
+		 * - https://github.com/grpc/grpc/blob/master/doc/PROTOCOL-HTTP2.md
+		 */
+		const char *authority = strstr(str.data, "://");
+		char *slash = (authority != NULL) ? strchr(authority + 3, '/') : NULL;
+
+		if (slash != NULL)
+		{
+			*slash = '\0';
+			str.len = slash - str.data;
+		}
+
+		appendStringInfoString(&str, method);
+	}
+	else
+	{
 		if (!pg_str_endswith(config->otlp.endpoint, "/"))
 			appendStringInfoString(&str, "/");
 
-		appendStringInfoString(&str, "v1/logs");
+		appendStringInfoString(&str, path);
+	}
+
+	return str.data;
+}
+
+/*
+ * Called by the background worker when PostgreSQL configuration changes.
+ */
+static void
+otel_LoadLogsConfig(struct otelLogsExporter *exporter,
+					const struct otelConfiguration *config)
+{
+	otel_LoadResource(config, &exporter->resource);
+	otel_PackLogsResource(exporter);
+
+	{
+		Assert(config->otlpLogs.endpoint == NULL); /* TODO: per-signal */
 
 		if (exporter->endpoint)
 			pfree(exporter->endpoint);
-		exporter->endpoint = str.data;
+		if (exporter->metricsEndpoint)
+			pfree(exporter->metricsEndpoint);
+
+		exporter->endpoint =
+			otel_SignalEndpoint(config, "v1/logs", PG_OTEL_GRPC_LOGS_EXPORT);
+		exporter->metricsEndpoint =
+			otel_SignalEndpoint(config, "v1/metrics", PG_OTEL_GRPC_METRICS_EXPORT);
 	}
 
 	{
 		Assert(config->otlpLogs.timeoutMS == 0); /* TODO: per-signal */
 
-		exporter->timeoutMS = config->otlp.timeoutMS;
+		/* Each export is limited by both the processor and the protocol */
+		exporter->timeoutMS = Min(config->otlp.timeoutMS,
+								  config->blrp.exportTimeoutMS);
+	}
+
+	{
+		Assert(config->otlpLogs.compression == 0); /* TODO: per-signal */
+
+		exporter->compression = config->otlp.compression;
+		exporter->compressionLevel = config->otlp.compressionLevel;
+	}
+
+	{
+		Assert(config->otlpLogs.concurrentExports == 0); /* TODO: per-signal */
+
+		Assert(config->otlpLogs.protocol == 0); /* TODO: per-signal */
+
+		/* gRPC is always HTTP/2 */
+		exporter->protocol = config->otlp.protocol;
+		exporter->exportsMax = config->otlp.concurrentExports;
+		exporter->http2 = config->otlp.http2 ||
+			exporter->protocol == PG_OTEL_CONFIG_PROTOCOL_GRPC;
+		exporter->requestMax = (size_t) config->otlp.maxRequestSizeKB * 1024;
 	}
 
 	/*
-	 * TODO: Accept settings for "Batch LogRecord Processor"
-	 * - https://docs.opentelemetry.io/reference/specification/sdk-environment-variables/
+	 * Settings for "Batch LogRecord Processor"
+	 * - https://docs.opentelemetry.io/reference/specification/logs/sdk/#batching-processor
 	 *
-	 * TODO: Clamp both >= 1 for now.
+	 * > maxExportBatchSize - the maximum batch size of every export. It must
+	 * > be smaller or equal to maxQueueSize.
 	 */
-	exporter->batchMax = 512;
-	exporter->queueMax = 2048;
+	exporter->queueMax = Max(1, config->blrp.maxQueueSize);
+	exporter->batchMax = Max(1, Min(config->blrp.maxExportBatchSize,
+									exporter->queueMax));
+	exporter->scheduleDelayMS = config->blrp.scheduleDelayMS;
+	exporter->attributeCountLimit = config->attributeCountLimit;
+
+	exporter->spill.sizeMax = (size_t) config->spillMaxSizeKB * 1024;
+	exporter->repeatIntervalMS = config->logs.dedupIntervalMS;
+	exporter->statementDedup = config->logs.statementDedup;
+	exporter->statementIntervalMS = config->logs.statementDedupIntervalMS;
+
+	/* Forget every statement when they are no longer reattached */
+	if (exporter->statementDedup != PG_OTEL_CONFIG_STATEMENT_DEDUP_REATTACH)
+		otel_ExpireStatements(exporter, DT_NOEND);
 
 	exporter->insecure = false;
 }
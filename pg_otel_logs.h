@@ -6,53 +6,361 @@
 #include "postgres.h"
 #include "lib/ilist.h"
 #include "nodes/pg_list.h"
+#include "port/pg_crc32c.h"
+#include "utils/hsearch.h"
 #include "utils/palloc.h"
+#include "utils/timestamp.h"
 
 #include "curl/curl.h"
+#include "zlib.h"
 
 #include "pg_otel_config.h"
+#include "pg_otel_logs_keys.h"
 #include "pg_otel_proto.h"
+#include "pg_otel_spill.h"
+
+/* An attribute key from pg_otel_logs_keys.h and its size */
+#define PG_OTEL_LOG_KEY(name) \
+	PG_OTEL_LOG_KEY_ ## name, (sizeof(PG_OTEL_LOG_KEY_ ## name) - 1)
+
+/*
+ * otelLogMessage is the fixed layout of one log message that backends send to
+ * the background worker. Strings follow it in the same record, each with a
+ * terminal null. A string is absent when its offset is zero.
+ */
+#define PG_OTEL_LOG_MESSAGE          0
+#define PG_OTEL_LOG_FUNCNAME         1
+#define PG_OTEL_LOG_FILENAME         2
+#define PG_OTEL_LOG_DATABASE         3
+#define PG_OTEL_LOG_USER             4
+#define PG_OTEL_LOG_STATEMENT        5
+#define PG_OTEL_LOG_INTERNAL_QUERY   6
+#define PG_OTEL_LOG_CONTEXT          7
+#define PG_OTEL_LOG_HINT             8
+#define PG_OTEL_LOG_DETAIL           9
+#define PG_OTEL_LOG_APPLICATION_NAME 10
+#define PG_OTEL_LOG_FIELDS           11
+
+struct otelLogMessage
+{
+	uint64 timeUnixNano;
+	int32  elevel;
+	int32  pid;
+	int32  sqlerrcode;
+	int32  lineno;
+	int32  cursorpos;
+	int32  internalpos;
+
+	/* The statement is absent when the worker has seen it recently */
+	uint64    queryId;
+	pg_crc32c statementHash; /* of the whole text; see [otel_StatementKey] */
+	bool      statementOmitted;
+
+	/* Set by the worker when this record stands for repeats of itself */
+	uint64 repeatFirstUnixNano;
+	uint32 repeatCount;
+
+	struct
+	{
+		uint32 offset, length;
+	} fields[PG_OTEL_LOG_FIELDS];
+};
+
+/*
+ * otelLogsRepeat is one log message that the background worker exported
+ * recently. Messages just like it are counted until deadline, then exported
+ * as one record with the time of the last one.
+ */
+#define PG_OTEL_LOGS_REPEATS_MAX 1024
+
+struct otelLogsRepeat
+{
+	pg_crc32c   key; /* see [otel_LogMessageHash] */
+	dlist_node  list_node;
+	TimestampTz deadline;
+
+	uint8_t *message; /* the first one */
+	size_t   size;
+
+	uint32 count;
+	uint64 lastUnixNano;
+};
+
+/*
+ * otelLogsStatement is the text of one statement that the background worker
+ * received recently. Log messages with the same key and no statement get this
+ * one; see [otel_StatementKey]. It is forgotten when no backend sends it again
+ * before expires.
+ */
+#define PG_OTEL_LOGS_STATEMENTS_MAX 1024
+
+struct otelLogsStatement
+{
+	uint64      key;
+	dlist_node  list_node;
+	TimestampTz expires;
+
+	char  *text;
+	size_t length;
+};
+
+/*
+ * otelLogsRecord is one encoded LogRecord, including the tag and length that
+ * make it an element of ScopeLogs.log_records.
+ */
+struct otelLogsRecord
+{
+	uint8_t *data;
+	uint32   size;
+	uint64   statementKey; /* of the statement text it carries, or zero */
+};
+
+/*
+ * otelPackedResource is the Resource of the exporter, encoded once each time
+ * the configuration is loaded. Batches with records from that configuration
+ * share it, and it is freed along with the last of them.
+ */
+struct otelPackedResource
+{
+	uint8_t *data;
+	size_t   size;
+	int      refs;
+};
+
+/*
+ * otelLogsResource is an encoded Resource and the run of records in a batch
+ * that are exported with it.
+ */
+struct otelLogsResource
+{
+	struct otelPackedResource *packed;
+	int      offset, length;
+	size_t   recordsSize; /* sum of their sizes */
+};
 
 /*
  * otelLogsBatch is a dlist_node of one memory context containing a list of
- * ResourceLogs. That list can be sent as a single ExportLogsServiceRequest.
+ * resources and their encoded records. These can be sent as a single
+ * ExportLogsServiceRequest.
  */
 struct otelLogsBatch
 {
 	dlist_node list_node;
 
 	MemoryContext context;
-	ProtobufCAllocator allocator;
 
 	int length, capacity, dropped;
-	OTEL_TYPE_LOGS(LogRecord) **records;
+	struct otelLogsRecord *records;
+	size_t size; /* encoded size of the request */
+
+	/* When it should be sent, even if it is not full */
+	TimestampTz deadline;
+
+	List *resourceLogs; /* struct otelLogsResource */
+
+	/*
+	 * An encoded request of signal; when not NULL, there are no records. Those
+	 * read from disk hold requestLength log records.
+	 */
+	uint8_t *request;
+	int      requestLength;
+	int      signal;
+	bool     spilled;
+};
+
+/*
+ * otelLogsStats counts what happens to log records and export requests since
+ * startUnixNano, when the exporter started or statistics were reset. Requests
+ * are counted by HTTP status, where zero means there was no response, and by
+ * duration in otel_ExportDurationBounds.
+ */
+#define PG_OTEL_LOGS_DROPPED_QUEUE_FULL 0
+#define PG_OTEL_LOGS_DROPPED_INVALID    1
+#define PG_OTEL_LOGS_DROPPED_OVERSIZED  2
+#define PG_OTEL_LOGS_DROPPED_EXPORT     3
+#define PG_OTEL_LOGS_DROPPED_REASONS    4
+
+#define PG_OTEL_EXPORT_DURATION_BOUNDS 14
+#define PG_OTEL_EXPORT_STATUSES        16
+
+static const double otel_ExportDurationBounds[PG_OTEL_EXPORT_DURATION_BOUNDS] = {
+	0.005, 0.01, 0.025, 0.05, 0.075, 0.1, 0.25, 0.5, 0.75, 1, 2.5, 5, 7.5, 10,
+};
 
-	List *resourceLogs; /* OTEL_TYPE_LOGS(ResourceLogs) */
+struct otelLogsStats
+{
+	uint64 startUnixNano;
+
+	uint64 received, exported;
+	uint64 dropped[PG_OTEL_LOGS_DROPPED_REASONS];
+	uint64 suppressed; /* by backends; see [otel_ReceiveSuppressedLogs] */
+	uint64 collapsed;  /* into other records; see [otel_RepeatLogMessage] */
+
+	uint64 bytesSent;
+
+	struct
+	{
+		long   status;
+		uint64 count;
+	} statuses[PG_OTEL_EXPORT_STATUSES];
+	int statusesLength;
+
+	uint64 durations[PG_OTEL_EXPORT_DURATION_BOUNDS + 1];
+	uint64 durationCount;
+	double durationSum; /* seconds */
+
+	/* Messages that backends sent and dropped; see [otel_PublishStat] */
+	uint64 ipcBytes, ipcDropped;
+
+	TimestampTz lastErrorAt, lastSuccessAt;
+	char        lastError[128];
+};
+
+/*
+ * otelRequestBody is a request as a list of pieces that are read in order
+ * while it is being sent.
+ */
+struct otelRequestBody
+{
+	struct
+	{
+		const uint8_t *data;
+		size_t size;
+	} *pieces;
+
+	int    length, capacity;
+	size_t size; /* sum of all pieces */
+
+	int    piece;  /* position of the next read */
+	size_t offset;
+
+	z_stream *deflate; /* compresses the pieces, when not NULL */
+	bool      deflated;
+
+	bool threaded; /* read by a pipeline thread; see [otel_PipelineSubmit] */
+};
+
+/*
+ * PG_OTEL_GRPC_DEFLATE_PIECE is the size of each piece of a compressed gRPC
+ * message; see [otel_FrameGRPCRequest].
+ */
+#define PG_OTEL_GRPC_DEFLATE_PIECE (64 * 1024)
+
+/*
+ * otelLogsExport is one HTTP transfer of the exporter. It is idle or sending
+ * one batch. Its curl handle and zlib stream are kept for the next batch.
+ */
+struct otelLogsExport
+{
+	dlist_node list_node;
+
+	CURL     *http;
+	char      httpErrorBuffer[CURL_ERROR_SIZE];
+	struct curl_slist *headers;
+
+	z_stream  deflate;
+	bool      deflateReady;
+
+	struct otelLogsBatch  *batch; /* NULL when idle */
+	struct otelRequestBody body;
+	CURLcode result; /* set by a pipeline when it finishes */
+
+	/* The gRPC message prefix and the status of the response */
+	uint8_t grpcPrefix[5];
+	int     grpcStatus;
+	char    grpcMessage[128];
 };
+
 struct otelLogsExporter
 {
 	dlist_head queue; /* struct otelLogsBatch */
 	int batchMax, queueLength, queueMax;
+	size_t requestMax;
+
+	struct otelLogsStats stats;
+
+	/* Recent log messages by hash, and in the order they expire */
+	HTAB         *repeats; /* struct otelLogsRepeat */
+	dlist_head    repeatsOrder;
+	MemoryContext repeatsContext;
+	int           repeatIntervalMS;
+
+	/* Recent statement texts by query_id, and in the order they expire */
+	HTAB         *statements; /* struct otelLogsStatement */
+	dlist_head    statementsOrder;
+	MemoryContext statementsContext;
+	int           statementDedup;
+	int           statementIntervalMS;
+	struct otelStatements *statementsSent; /* in shared memory, when not NULL */
+
+	/* Metrics about this exporter waiting to be sent */
+	struct otelLogsBatch *metrics;
+	char *metricsEndpoint;
+
+	/* Requests that could not be sent, while the collector is unavailable */
+	struct otelSpill spill;
+	bool failing;
+	int  retryDelayMS;
+	TimestampTz retryAt;
+
+	/* Whether the last export of metrics failed; they are never retried */
+	bool metricsFailing;
+
+	dlist_head exports; /* struct otelLogsExport */
+	int exportsLength, exportsMax; /* in flight */
+	struct otelPipeline *pipeline; /* sends exports, when not NULL */
+
+	int scheduleDelayMS;
+	int attributeCountLimit; /* of each LogRecord */
 
 	char *endpoint;
+	bool  http2;
 	bool  insecure;
+	int   protocol;
 	int   timeoutMS;
 	struct otelResource resource;
+	struct otelPackedResource *packedResource; /* of the current configuration */
+
+	int compression, compressionLevel;
+
+	/* Encoded InstrumentationScope and schema_url of every request */
+	uint8_t scope[64], schemaURL[64];
+	size_t  scopeSize, schemaURLSize;
 };
 
+static void
+otel_ResetLogsStats(struct otelLogsStats *stats);
+
 static void
 otel_InitLogsExporter(struct otelLogsExporter *exporter,
-					  const struct otelConfiguration *config);
+					  const struct otelConfiguration *config, int channel);
+
+static void
+otel_CloseLogsExporter(struct otelLogsExporter *exporter);
 
 static void
 otel_LoadLogsConfig(struct otelLogsExporter *exporter,
 					const struct otelConfiguration *config);
 
+static void
+otel_ReceiveSuppressedLogs(struct otelLogsExporter *exporter,
+						   int elevel, uint64 count);
+
 static void
 otel_ReceiveLogMessage(struct otelLogsExporter *exporter,
 					   const uint8_t *message, size_t size);
 
+static bool
+otel_RepeatedLogsDeadline(struct otelLogsExporter *exporter, TimestampTz *deadline);
+
+static bool
+otel_LogsExportDeadline(struct otelLogsExporter *exporter, TimestampTz *deadline);
+
+static void
+otel_StartLogsExports(struct otelLogsExporter *exporter, CURLM *multi, bool flush);
+
 static void
-otel_SendLogsToCollector(struct otelLogsExporter *exporter, CURL *http);
+otel_FinishLogsExport(struct otelLogsExporter *exporter, CURLM *multi,
+					  CURL *http, CURLcode result);
 
 #endif
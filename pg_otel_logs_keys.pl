@@ -0,0 +1,58 @@
+#!/usr/bin/env perl
+#
+# Prints a C header of LogRecord attribute keys that are already encoded as
+# protobuf. Each one is the tag, length, and bytes of KeyValue.key followed by
+# the tag of KeyValue.value, so the encoder can copy it in one step.
+#
+# - https://protobuf.dev/programming-guides/encoding/
+#
+use strict;
+use warnings;
+
+# These are the attributes set by [otel_EncodeLogRecord].
+my @keys = qw(
+	code.filepath
+	code.function
+	code.lineno
+	db.name
+	db.postgresql.application_name
+	db.postgresql.context
+	db.postgresql.cursor_position
+	db.postgresql.detail
+	db.postgresql.hint
+	db.postgresql.internal_position
+	db.postgresql.internal_query
+	db.postgresql.query_id
+	db.postgresql.state_code
+	db.statement
+	db.user
+	pg_otel.repeat.count
+	pg_otel.repeat.first_time_unix_nano
+	process.pid
+);
+
+print <<'HEADER';
+/* Generated by pg_otel_logs_keys.pl; do not edit. */
+
+#ifndef PG_OTEL_LOGS_KEYS_H
+#define PG_OTEL_LOGS_KEYS_H
+
+HEADER
+
+for my $key (@keys)
+{
+	my $name = uc($key) =~ s/[^A-Z0-9]/_/gr;
+
+	# The length must fit in a single-byte varint.
+	die "attribute key is too long: $key\n" if length($key) > 127;
+
+	# KeyValue.key is field 1 and KeyValue.value is field 2; both are
+	# length-delimited (wire type 2).
+	printf qq(#define PG_OTEL_LOG_KEY_%s "\\x0a\\x%02x" "%s" "\\x12"\n),
+		$name, length($key), $key;
+}
+
+print <<'FOOTER';
+
+#endif
+FOOTER
@@ -0,0 +1,323 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#include <sys/time.h>
+
+#include "postgres.h"
+#include "utils/memutils.h"
+
+#include "pg_otel.h"
+#include "pg_otel_logs.h"
+#include "pg_otel_metrics.h"
+#include "pg_otel_proto.h"
+
+/*
+ * Write the tag and length of an embedded message followed by the message.
+ * The message is written twice: once to measure it and once for real.
+ */
+static void
+otel_EncodeMessage(struct otelEncoder *e, uint8_t tag,
+				   void (*encode) (struct otelEncoder *, const void *),
+				   const void *arg)
+{
+	struct otelEncoder measure = { .out = NULL, .size = 0 };
+
+	encode(&measure, arg);
+	otel_EncodeLength(e, tag, measure.size);
+	encode(e, arg);
+}
+
+/* Write eight bytes of a packed fixed64 or double field */
+static void
+otel_EncodePacked64(struct otelEncoder *e, uint64 value)
+{
+	for (int i = 0; i < 8; i++)
+		otel_EncodeByte(e, (uint8_t) (value >> (8 * i)));
+}
+
+static uint64
+otel_DoubleBits(double value)
+{
+	uint64 bits;
+
+	StaticAssertStmt(sizeof(bits) == sizeof(value), "double is not 64 bits");
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/* Write the AnyValue of the attribute of a point */
+static void
+otel_EncodeMetricAttributeValue(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetricPoint *point = arg;
+
+	if (point->string != NULL)
+		otel_EncodeString(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+						  point->string, strlen(point->string));
+	else
+	{
+		otel_EncodeByte(e, OTEL_WIRE_TAG(3, OTEL_WIRE_VARINT));
+		otel_EncodeVarint(e, (uint64) point->number);
+	}
+}
+
+/* Write the KeyValue of the attribute of a point */
+static void
+otel_EncodeMetricAttribute(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetricPoint *point = arg;
+
+	otel_EncodeString(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+					  point->key, strlen(point->key));
+	otel_EncodeMessage(e, OTEL_WIRE_TAG(2, OTEL_WIRE_LEN),
+					   otel_EncodeMetricAttributeValue, point);
+}
+
+/* Write one NumberDataPoint of an integer gauge or sum */
+static void
+otel_EncodeNumberPoint(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetric *metric = ((const void *const *) arg)[0];
+	const struct otelMetricPoint *point = ((const void *const *) arg)[1];
+
+	if (point->key != NULL)
+		otel_EncodeMessage(e, OTEL_WIRE_TAG(7, OTEL_WIRE_LEN),
+						   otel_EncodeMetricAttribute, point);
+	if (metric->worker != NULL)
+		otel_EncodeMessage(e, OTEL_WIRE_TAG(7, OTEL_WIRE_LEN),
+						   otel_EncodeMetricAttribute, metric->worker);
+
+	if (metric->kind == PG_OTEL_METRIC_SUM)
+		otel_EncodeFixed64(e, OTEL_WIRE_TAG(2, OTEL_WIRE_FIXED64), metric->startUnixNano);
+
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(3, OTEL_WIRE_FIXED64), metric->timeUnixNano);
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(6, OTEL_WIRE_FIXED64), (uint64) point->value);
+}
+
+/* Write the HistogramDataPoint of export durations */
+static void
+otel_EncodeHistogramPoint(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetric *metric = arg;
+	const struct otelLogsStats *stats = metric->stats;
+
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(2, OTEL_WIRE_FIXED64), metric->startUnixNano);
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(3, OTEL_WIRE_FIXED64), metric->timeUnixNano);
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(4, OTEL_WIRE_FIXED64), stats->durationCount);
+	otel_EncodeFixed64(e, OTEL_WIRE_TAG(5, OTEL_WIRE_FIXED64),
+					   otel_DoubleBits(stats->durationSum));
+
+	otel_EncodeLength(e, OTEL_WIRE_TAG(6, OTEL_WIRE_LEN),
+					  8 * lengthof(stats->durations));
+	for (int i = 0; i < lengthof(stats->durations); i++)
+		otel_EncodePacked64(e, stats->durations[i]);
+
+	otel_EncodeLength(e, OTEL_WIRE_TAG(7, OTEL_WIRE_LEN),
+					  8 * lengthof(otel_ExportDurationBounds));
+	for (int i = 0; i < lengthof(otel_ExportDurationBounds); i++)
+		otel_EncodePacked64(e, otel_DoubleBits(otel_ExportDurationBounds[i]));
+
+	if (metric->worker != NULL)
+		otel_EncodeMessage(e, OTEL_WIRE_TAG(9, OTEL_WIRE_LEN),
+						   otel_EncodeMetricAttribute, metric->worker);
+}
+
+/* Write the Gauge, Sum, or Histogram of a metric */
+static void
+otel_EncodeMetricData(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetric *metric = arg;
+
+	if (metric->kind == PG_OTEL_METRIC_HISTOGRAM)
+		otel_EncodeMessage(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+						   otel_EncodeHistogramPoint, metric);
+	else
+		for (int i = 0; i < metric->length; i++)
+		{
+			const void *point[2] = { metric, &metric->points[i] };
+
+			otel_EncodeMessage(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+							   otel_EncodeNumberPoint, point);
+		}
+
+	/* AGGREGATION_TEMPORALITY_CUMULATIVE */
+	if (metric->kind != PG_OTEL_METRIC_GAUGE)
+	{
+		otel_EncodeByte(e, OTEL_WIRE_TAG(2, OTEL_WIRE_VARINT));
+		otel_EncodeVarint(e, 2);
+	}
+
+	/* is_monotonic */
+	if (metric->kind == PG_OTEL_METRIC_SUM)
+	{
+		otel_EncodeByte(e, OTEL_WIRE_TAG(3, OTEL_WIRE_VARINT));
+		otel_EncodeVarint(e, 1);
+	}
+}
+
+static void
+otel_EncodeMetric(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetric *metric = arg;
+
+	otel_EncodeString(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+					  metric->name, strlen(metric->name));
+	otel_EncodeString(e, OTEL_WIRE_TAG(2, OTEL_WIRE_LEN),
+					  metric->description, strlen(metric->description));
+	otel_EncodeString(e, OTEL_WIRE_TAG(3, OTEL_WIRE_LEN),
+					  metric->unit, strlen(metric->unit));
+	otel_EncodeMessage(e, OTEL_WIRE_TAG(metric->kind, OTEL_WIRE_LEN),
+					   otel_EncodeMetricData, metric);
+}
+
+/*
+ * otelMetricsRequest is everything in one ExportMetricsServiceRequest.
+ * - https://github.com/open-telemetry/opentelemetry-proto/blob/main/opentelemetry/proto/metrics/v1/metrics.proto
+ */
+struct otelMetricsRequest
+{
+	const struct otelLogsExporter *exporter;
+	const uint8_t *resource;
+	size_t resourceSize;
+
+	const struct otelMetric *metrics;
+	int length;
+};
+
+static void
+otel_EncodeScopeMetrics(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetricsRequest *request = arg;
+	const struct otelLogsExporter *exporter = request->exporter;
+
+	otel_EncodeRaw(e, exporter->scope, exporter->scopeSize);
+
+	for (int i = 0; i < request->length; i++)
+		otel_EncodeMessage(e, OTEL_WIRE_TAG(2, OTEL_WIRE_LEN),
+						   otel_EncodeMetric, &request->metrics[i]);
+
+	otel_EncodeRaw(e, exporter->schemaURL, exporter->schemaURLSize);
+}
+
+static void
+otel_EncodeResourceMetrics(struct otelEncoder *e, const void *arg)
+{
+	const struct otelMetricsRequest *request = arg;
+	const struct otelLogsExporter *exporter = request->exporter;
+
+	otel_EncodeString(e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+					  (const char *) request->resource, request->resourceSize);
+	otel_EncodeMessage(e, OTEL_WIRE_TAG(2, OTEL_WIRE_LEN),
+					   otel_EncodeScopeMetrics, request);
+	otel_EncodeRaw(e, exporter->schemaURL, exporter->schemaURLSize);
+}
+
+/*
+ * Called by the background worker to send metrics about the exporter with its
+ * next export. These replace any that have not been sent yet. When there is
+ * more than one exporter, worker is the number of this one; otherwise it is
+ * negative.
+ */
+static void
+otel_QueueExporterMetrics(struct otelLogsExporter *exporter, int worker)
+{
+	MemoryContext ctx = AllocSetContextCreate(NULL, /* parent */
+											  PG_OTEL_LIBRARY " metrics batch",
+											  ALLOCSET_SMALL_SIZES);
+	struct otelLogsBatch *batch = MemoryContextAllocZero(ctx, sizeof(*batch));
+	const struct otelLogsStats *stats = &exporter->stats;
+	struct otelMetricsRequest request = { .exporter = exporter };
+	struct otelEncoder e = { .out = NULL, .size = 0 };
+	struct timeval tv;
+	uint64 now;
+
+	struct otelMetricPoint received = { .value = stats->received };
+	struct otelMetricPoint exported = { .value = stats->exported };
+	struct otelMetricPoint suppressed = { .value = stats->suppressed };
+	struct otelMetricPoint collapsed = { .value = stats->collapsed };
+	struct otelMetricPoint queueSize = { .value = exporter->queueLength };
+	struct otelMetricPoint queueCapacity = { .value = exporter->queueMax };
+	struct otelMetricPoint spillSize = { .value = exporter->spill.size };
+	struct otelMetricPoint sent = { .value = stats->bytesSent };
+	struct otelMetricPoint number = { .key = "pg_otel.worker", .number = worker };
+
+	struct otelMetricPoint dropped[] = {
+		{ .key = "reason", .string = "ipc", .value = stats->ipcDropped },
+		{ .key = "reason", .string = "queue_full",
+		  .value = stats->dropped[PG_OTEL_LOGS_DROPPED_QUEUE_FULL] },
+		{ .key = "reason", .string = "invalid",
+		  .value = stats->dropped[PG_OTEL_LOGS_DROPPED_INVALID] },
+		{ .key = "reason", .string = "oversized",
+		  .value = stats->dropped[PG_OTEL_LOGS_DROPPED_OVERSIZED] },
+		{ .key = "reason", .string = "export",
+		  .value = stats->dropped[PG_OTEL_LOGS_DROPPED_EXPORT] },
+	};
+	struct otelMetricPoint requests[PG_OTEL_EXPORT_STATUSES];
+
+	struct otelMetric metrics[] = {
+		{ "pg_otel.logs.received", "Log records received by the exporter",
+		  "{record}", PG_OTEL_METRIC_SUM, &received, 1 },
+		{ "pg_otel.logs.exported", "Log records accepted by the collector",
+		  "{record}", PG_OTEL_METRIC_SUM, &exported, 1 },
+		{ "pg_otel.logs.suppressed", "Log records suppressed by rate limits or sampling",
+		  "{record}", PG_OTEL_METRIC_SUM, &suppressed, 1 },
+		{ "pg_otel.logs.collapsed", "Log records counted as repeats of another",
+		  "{record}", PG_OTEL_METRIC_SUM, &collapsed, 1 },
+		{ "pg_otel.logs.dropped", "Log records that were not exported",
+		  "{record}", PG_OTEL_METRIC_SUM, dropped, lengthof(dropped) },
+		{ "pg_otel.logs.queue.size", "Log records waiting to be exported",
+		  "{record}", PG_OTEL_METRIC_GAUGE, &queueSize, 1 },
+		{ "pg_otel.logs.queue.capacity", "Maximum log records waiting to be exported",
+		  "{record}", PG_OTEL_METRIC_GAUGE, &queueCapacity, 1 },
+		{ "pg_otel.spill.size", "Disk space used by requests that could not be sent",
+		  "By", PG_OTEL_METRIC_GAUGE, &spillSize, 1 },
+		{ "pg_otel.export.sent", "Bytes sent to the collector",
+		  "By", PG_OTEL_METRIC_SUM, &sent, 1 },
+		{ "pg_otel.export.requests", "Export requests by HTTP status; zero is no response",
+		  "{request}", PG_OTEL_METRIC_SUM, requests, stats->statusesLength },
+		{ "pg_otel.export.duration", "Duration of export requests",
+		  "s", PG_OTEL_METRIC_HISTOGRAM, NULL, 0 },
+	};
+
+	gettimeofday(&tv, NULL);
+	now = tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+
+	for (int i = 0; i < stats->statusesLength; i++)
+	{
+		requests[i].key = "http.response.status_code";
+		requests[i].string = NULL;
+		requests[i].number = stats->statuses[i].status;
+		requests[i].value = stats->statuses[i].count;
+	}
+
+	for (int i = 0; i < lengthof(metrics); i++)
+	{
+		metrics[i].stats = stats;
+		metrics[i].startUnixNano = stats->startUnixNano;
+		metrics[i].timeUnixNano = now;
+		metrics[i].worker = (worker < 0) ? NULL : &number;
+	}
+
+	/* The same resource as logs; it is copied into the request below */
+	request.resource = exporter->packedResource->data;
+	request.resourceSize = exporter->packedResource->size;
+	request.metrics = metrics;
+	request.length = lengthof(metrics);
+
+	otel_EncodeMessage(&e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+					   otel_EncodeResourceMetrics, &request);
+
+	batch->context = ctx;
+	batch->signal = PG_OTEL_CONFIG_METRICS;
+	batch->size = e.size;
+	batch->request = MemoryContextAlloc(ctx, batch->size);
+
+	e.out = batch->request;
+	e.size = 0;
+	otel_EncodeMessage(&e, OTEL_WIRE_TAG(1, OTEL_WIRE_LEN),
+					   otel_EncodeResourceMetrics, &request);
+	Assert(e.size == batch->size);
+
+	if (exporter->metrics != NULL)
+		MemoryContextDelete(exporter->metrics->context);
+	exporter->metrics = batch;
+}
@@ -0,0 +1,51 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#ifndef PG_OTEL_METRICS_H
+#define PG_OTEL_METRICS_H
+
+#include "postgres.h"
+
+#include "pg_otel_logs.h"
+#include "pg_otel_proto.h"
+
+/* The field of each kind of data in an OTLP Metric */
+#define PG_OTEL_METRIC_GAUGE     5
+#define PG_OTEL_METRIC_SUM       7
+#define PG_OTEL_METRIC_HISTOGRAM 9
+
+/*
+ * otelMetricPoint is one value of a metric with at most one attribute. The
+ * attribute value is string when that is not NULL, otherwise number.
+ */
+struct otelMetricPoint
+{
+	const char *key;
+	const char *string;
+	int64       number;
+
+	int64       value;
+};
+
+/*
+ * otelMetric is one metric about the exporter. Sums are monotonic and
+ * cumulative since start. A histogram has one point from stats.
+ */
+struct otelMetric
+{
+	const char *name, *description, *unit;
+	uint8_t     kind;
+
+	const struct otelMetricPoint *points;
+	int length;
+
+	const struct otelLogsStats *stats;
+	uint64 startUnixNano, timeUnixNano;
+
+	/* Every point has this attribute when it is not NULL */
+	const struct otelMetricPoint *worker;
+};
+
+static void
+otel_QueueExporterMetrics(struct otelLogsExporter *exporter, int worker);
+
+#endif
@@ -0,0 +1,323 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "postgres.h"
+#include "storage/latch.h"
+#include "utils/memutils.h"
+
+#include "curl/curl.h"
+
+#include "pg_otel_logs.h"
+#include "pg_otel_pipeline.h"
+
+/*
+ * Called by the writer of queue to append export. Returns false when the
+ * queue is full.
+ */
+static bool
+otel_PipelinePush(struct otelPipelineQueue *queue, struct otelLogsExport *export)
+{
+	uint32 head = pg_atomic_read_u32(&queue->head);
+	uint32 tail = pg_atomic_read_u32(&queue->tail);
+
+	if (head - tail >= PG_OTEL_PIPELINE_SLOTS)
+		return false;
+
+	queue->slots[head % PG_OTEL_PIPELINE_SLOTS] = export;
+
+	/* The slot must be filled before the reader can see it */
+	pg_write_barrier();
+	pg_atomic_write_u32(&queue->head, head + 1);
+	return true;
+}
+
+/*
+ * Called by the reader of queue to take its oldest export. Returns NULL when
+ * the queue is empty.
+ */
+static struct otelLogsExport *
+otel_PipelinePop(struct otelPipelineQueue *queue)
+{
+	uint32 tail = pg_atomic_read_u32(&queue->tail);
+	struct otelLogsExport *export;
+
+	if (pg_atomic_read_u32(&queue->head) == tail)
+		return NULL;
+
+	/* The slot must be read after head says it is filled */
+	pg_read_barrier();
+	export = queue->slots[tail % PG_OTEL_PIPELINE_SLOTS];
+
+	pg_memory_barrier();
+	pg_atomic_write_u32(&queue->tail, tail + 1);
+	return export;
+}
+
+/* Wake the other side of a pipe; a full pipe is already awake */
+static void
+otel_PipelineWake(int fd)
+{
+	char byte = 0;
+	ssize_t rc pg_attribute_unused();
+
+	rc = write(fd, &byte, 1);
+}
+
+/* Read everything in a pipe so the next write wakes its reader again */
+static void
+otel_PipelineClear(int fd)
+{
+	char buffer[64];
+
+	while (read(fd, buffer, sizeof(buffer)) > 0)
+		continue;
+}
+
+#ifndef WIN32
+/*
+ * The thread of a pipeline. It adds submitted exports to its multi handle,
+ * runs them, and hands back those that finish. Nothing here may call into
+ * PostgreSQL; its memory, latches, and logging are for the worker alone.
+ */
+static void *
+otel_PipelineMain(void *arg)
+{
+	struct otelPipeline *pipeline = arg;
+	struct curl_waitfd wake = {
+		.fd = pipeline->wake[0],
+		.events = CURL_WAIT_POLLIN,
+	};
+
+	while (pg_atomic_read_u32(&pipeline->stopping) == 0)
+	{
+		struct otelLogsExport *export;
+		bool finished = false;
+		CURLMsg *msg;
+		int remaining, running;
+
+		while ((export = otel_PipelinePop(&pipeline->submitted)) != NULL)
+		{
+			curl_multi_setopt(pipeline->multi, CURLMOPT_PIPELINING, pipeline->pipelining);
+#if LIBCURL_VERSION_NUM >= 0x074300 /* 7.67.0 */
+			curl_multi_setopt(pipeline->multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+							  pipeline->streams);
+#endif
+
+			/* Hand back an export that cannot start as one that failed */
+			if (curl_multi_add_handle(pipeline->multi, export->http) != CURLM_OK)
+			{
+				export->result = CURLE_FAILED_INIT;
+				export->httpErrorBuffer[0] = '\0';
+				otel_PipelinePush(&pipeline->finished, export);
+				finished = true;
+			}
+		}
+
+		curl_multi_perform(pipeline->multi, &running);
+
+		while ((msg = curl_multi_info_read(pipeline->multi, &remaining)) != NULL)
+		{
+			CURL *http = msg->easy_handle;
+
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			/* The message is gone once its handle is removed */
+			curl_easy_getinfo(http, CURLINFO_PRIVATE, (char **) &export);
+			export->result = msg->data.result;
+			curl_multi_remove_handle(pipeline->multi, http);
+
+			/* There is a slot for every export the worker has in flight */
+			otel_PipelinePush(&pipeline->finished, export);
+			finished = true;
+		}
+
+		if (finished)
+			otel_PipelineWake(pipeline->done[1]);
+
+		/* Curl waits no longer than its own next timeout */
+		curl_multi_wait(pipeline->multi, &wake, 1, 1000, NULL);
+		otel_PipelineClear(pipeline->wake[0]);
+	}
+
+	return NULL;
+}
+#endif
+
+/* Wake the background worker when the pipeline finishes an export */
+static void
+otel_AddPipelineEventToSet(struct otelPipeline *pipeline, WaitEventSet *set)
+{
+	Assert(pipeline != NULL);
+	Assert(set != NULL);
+
+	AddWaitEventToSet(set, WL_SOCKET_READABLE, pipeline->done[0], NULL, pipeline);
+}
+
+/*
+ * Called by the background worker to take back an export that the pipeline
+ * has finished. Its result is in export->result. Returns NULL when there are
+ * no more.
+ */
+static struct otelLogsExport *
+otel_PipelineFinished(struct otelPipeline *pipeline)
+{
+	struct otelLogsExport *export;
+
+	if ((export = otel_PipelinePop(&pipeline->finished)) == NULL)
+	{
+		/* Clear the pipe then look again, so no export is missed */
+		otel_PipelineClear(pipeline->done[0]);
+		export = otel_PipelinePop(&pipeline->finished);
+	}
+
+	return export;
+}
+
+/*
+ * Called by the background worker to hand export to the pipeline. Its curl
+ * handle and body must be ready, and the worker must not touch either until
+ * the export comes back from [otel_PipelineFinished]. Returns false when the
+ * pipeline cannot take it.
+ */
+static bool
+otel_PipelineSubmit(struct otelPipeline *pipeline, struct otelLogsExport *export,
+					bool http2, int streams)
+{
+	/* Curl cannot use signals for timeouts in a thread */
+	curl_easy_setopt(export->http, CURLOPT_NOSIGNAL, 1L);
+
+	pipeline->pipelining = http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING;
+	pipeline->streams = streams;
+
+	if (!otel_PipelinePush(&pipeline->submitted, export))
+		return false;
+
+	otel_PipelineWake(pipeline->wake[1]);
+	return true;
+}
+
+/* Create a pipe that does not block on either end */
+static bool
+otel_PipelinePipe(int fds[2])
+{
+#ifndef WIN32
+	if (pipe(fds) < 0)
+		return false;
+
+	if (fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+		fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Called by the background worker to start a pipeline thread. Returns NULL
+ * when that is not possible, and the worker sends exports itself.
+ */
+static struct otelPipeline *
+otel_StartPipeline(void)
+{
+#ifndef WIN32
+	struct otelPipeline *pipeline =
+		MemoryContextAllocZero(TopMemoryContext, sizeof(*pipeline));
+	sigset_t blocked, previous;
+	int rc;
+
+	pg_atomic_init_u32(&pipeline->submitted.head, 0);
+	pg_atomic_init_u32(&pipeline->submitted.tail, 0);
+	pg_atomic_init_u32(&pipeline->finished.head, 0);
+	pg_atomic_init_u32(&pipeline->finished.tail, 0);
+	pg_atomic_init_u32(&pipeline->stopping, 0);
+
+	if (!otel_PipelinePipe(pipeline->wake))
+	{
+		ereport(WARNING,
+				(errcode_for_socket_access(),
+				 errmsg("could not create pipe for otel pipeline: %m")));
+		pfree(pipeline);
+		return NULL;
+	}
+
+	if (!otel_PipelinePipe(pipeline->done))
+	{
+		ereport(WARNING,
+				(errcode_for_socket_access(),
+				 errmsg("could not create pipe for otel pipeline: %m")));
+		close(pipeline->wake[0]);
+		close(pipeline->wake[1]);
+		pfree(pipeline);
+		return NULL;
+	}
+
+	if ((pipeline->multi = curl_multi_init()) == NULL)
+	{
+		ereport(WARNING, (errmsg("could not initialize curl for otel pipeline")));
+		otel_StopPipeline(pipeline);
+		return NULL;
+	}
+
+	/*
+	 * Signals are for the worker and its handlers, so the thread starts with
+	 * every one of them blocked.
+	 */
+	sigfillset(&blocked);
+	pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+	rc = pthread_create(&pipeline->thread, NULL, otel_PipelineMain, pipeline);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	if (rc != 0)
+	{
+		errno = rc;
+		ereport(WARNING, (errmsg("could not start otel pipeline thread: %m")));
+		curl_multi_cleanup(pipeline->multi);
+		pipeline->multi = NULL;
+		otel_StopPipeline(pipeline);
+		return NULL;
+	}
+
+	return pipeline;
+#else
+	ereport(WARNING,
+			(errmsg("otel.exporter_pipeline is not supported on this platform")));
+	return NULL;
+#endif
+}
+
+/*
+ * Called by the background worker to stop and free a pipeline. The worker
+ * should have nothing in flight.
+ */
+static void
+otel_StopPipeline(struct otelPipeline *pipeline)
+{
+#ifndef WIN32
+	Assert(pipeline != NULL);
+
+	/* The thread exists only when it has a multi handle */
+	if (pipeline->multi != NULL)
+	{
+		pg_atomic_write_u32(&pipeline->stopping, 1);
+		otel_PipelineWake(pipeline->wake[1]);
+		pthread_join(pipeline->thread, NULL);
+		curl_multi_cleanup(pipeline->multi);
+	}
+
+	close(pipeline->wake[0]);
+	close(pipeline->wake[1]);
+	close(pipeline->done[0]);
+	close(pipeline->done[1]);
+	pfree(pipeline);
+#endif
+}
@@ -0,0 +1,73 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#ifndef PG_OTEL_PIPELINE_H
+#define PG_OTEL_PIPELINE_H
+
+#include "postgres.h"
+#include "port/atomics.h"
+#include "storage/latch.h"
+
+#include "curl/curl.h"
+
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+/* More than otel.otlp_concurrent_exports allows, so a queue is never full */
+#define PG_OTEL_PIPELINE_SLOTS 128
+
+struct otelLogsExport;
+
+/*
+ * otelPipelineQueue is a bounded queue of exports with one writer and one
+ * reader on different threads. The writer fills a slot before advancing head,
+ * and the reader empties it before advancing tail. Neither waits on the other.
+ */
+struct otelPipelineQueue
+{
+	pg_atomic_uint32 head;
+	pg_atomic_uint32 tail;
+	struct otelLogsExport *slots[PG_OTEL_PIPELINE_SLOTS];
+};
+
+/*
+ * otelPipeline is a thread of the background worker that compresses and sends
+ * export requests with its own curl multi handle. It calls nothing else in
+ * PostgreSQL: the worker gives it exports whose curl handle and body are
+ * ready, and takes them back once they finish. Each side writes to a pipe to
+ * wake the other.
+ */
+struct otelPipeline
+{
+#ifndef WIN32
+	pthread_t thread;
+#endif
+	CURLM    *multi; /* NULL until the thread starts */
+
+	struct otelPipelineQueue submitted, finished;
+	pg_atomic_uint32 stopping;
+
+	/* How the exporter multiplexes; written before each export is submitted */
+	long pipelining, streams;
+
+	int wake[2]; /* from the worker to the thread */
+	int done[2]; /* from the thread to the worker */
+};
+
+static void
+otel_AddPipelineEventToSet(struct otelPipeline *pipeline, WaitEventSet *set);
+
+static struct otelLogsExport *
+otel_PipelineFinished(struct otelPipeline *pipeline);
+
+static bool
+otel_PipelineSubmit(struct otelPipeline *pipeline, struct otelLogsExport *export,
+					bool http2, int streams);
+
+static struct otelPipeline *
+otel_StartPipeline(void);
+
+static void
+otel_StopPipeline(struct otelPipeline *pipeline);
+
+#endif
@@ -2,54 +2,10 @@
 
 #include "postgres.h"
 #include "utils/guc.h"
-#include "utils/palloc.h"
 
 #include "pg_otel.h"
 #include "pg_otel_proto.h"
 
-/* Allocate size memory, as needed by [ProtobufCAllocator.alloc] */
-static void *
-otel_ProtobufAllocatorAlloc(void *context, size_t size) {
-	return MemoryContextAlloc(context, size);
-}
-
-/* Free memory at pointer, as needed by [ProtobufCAllocator.free] */
-static void
-otel_ProtobufAllocatorFree(void *context, void *pointer) {
-	pfree(pointer);
-}
-
-/* Initialize allocator to allocate within ctx */
-static void
-otel_InitProtobufCAllocator(ProtobufCAllocator *allocator, MemoryContext ctx)
-{
-	Assert(allocator != NULL);
-
-	allocator->allocator_data = ctx;
-	allocator->alloc = otel_ProtobufAllocatorAlloc;
-	allocator->free = otel_ProtobufAllocatorFree;
-}
-
-static void
-otel_AttributeInt(OTEL_TYPE_COMMON(AnyValue) *anyValues,
-				  OTEL_TYPE_COMMON(KeyValue) *keyValues,
-				  OTEL_TYPE_COMMON(KeyValue) **attributes,
-				  size_t *n_attributes, const char *key, int value)
-{
-	size_t i = *n_attributes;
-
-	OTEL_FUNC_COMMON(any_value__init)(&anyValues[i]);
-	anyValues[i].int_value = value;
-	anyValues[i].value_case = OTEL_VALUE_CASE(INT);
-
-	OTEL_FUNC_COMMON(key_value__init)(&keyValues[i]);
-	keyValues[i].key = (char *)key;
-	keyValues[i].value = &anyValues[i];
-
-	attributes[i] = &keyValues[i];
-	*n_attributes += 1;
-}
-
 static void
 otel_AttributeStr(OTEL_TYPE_COMMON(AnyValue) *anyValues,
 				  OTEL_TYPE_COMMON(KeyValue) *keyValues,
@@ -79,32 +35,6 @@ otel_CompareKeyValueKeys(const void *a, const void *b)
 	return strcmp(kva->key, kvb->key);
 }
 
-static void
-otel_LogAttributeInt(struct otelLogRecord *r, const char *key, int value)
-{
-	Assert(r != NULL);
-	Assert(r->record.n_attributes < PG_OTEL_LOG_RECORD_MAX_ATTRIBUTES);
-
-	otel_AttributeInt(r->attrAnyValues,
-					  r->attrKeyValues,
-					  r->record.attributes,
-					  &r->record.n_attributes,
-					  key, value);
-}
-
-static void
-otel_LogAttributeStr(struct otelLogRecord *r, const char *key, const char *value)
-{
-	Assert(r != NULL);
-	Assert(r->record.n_attributes < PG_OTEL_LOG_RECORD_MAX_ATTRIBUTES);
-
-	otel_AttributeStr(r->attrAnyValues,
-					  r->attrKeyValues,
-					  r->record.attributes,
-					  &r->record.n_attributes,
-					  key, value);
-}
-
 static void
 otel_ResourceAttributeStr(struct otelResource *r,
 						  const char *key, const char *value)
@@ -28,34 +28,96 @@
 #define OTEL_VALUE_CASE(name) \
 	OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_ ## name ## _VALUE
 
-static void otel_InitProtobufCAllocator(ProtobufCAllocator *, MemoryContext);
-
-struct otelLogRecord
+/*
+ * Protobuf field tags for the wire types we write directly.
+ * - https://protobuf.dev/programming-guides/encoding/
+ */
+#define OTEL_WIRE_VARINT  0
+#define OTEL_WIRE_FIXED64 1
+#define OTEL_WIRE_LEN     2
+#define OTEL_WIRE_TAG(field, wire) ((uint8_t) (((field) << 3) | (wire)))
+
+/*
+ * otelEncoder writes protobuf in one pass without allocating. When out is
+ * NULL, it only counts the bytes that would be written; that count is how the
+ * length of an embedded message is known before it is written.
+ */
+struct otelEncoder
 {
-	OTEL_TYPE_LOGS(LogRecord)   record;
-	OTEL_TYPE_COMMON(AnyValue)  attrAnyValues[PG_OTEL_LOG_RECORD_MAX_ATTRIBUTES];
-	OTEL_TYPE_COMMON(KeyValue)  attrKeyValues[PG_OTEL_LOG_RECORD_MAX_ATTRIBUTES];
-	OTEL_TYPE_COMMON(KeyValue) *attrList[PG_OTEL_LOG_RECORD_MAX_ATTRIBUTES];
-	OTEL_TYPE_COMMON(AnyValue)  body;
+	uint8_t *out;
+	size_t   size;
 };
 
-static void
-otel_InitLogRecord(struct otelLogRecord *r)
+static inline size_t
+otel_VarintSize(uint64 value)
 {
-	Assert(r != NULL);
+	size_t size = 1;
+
+	while (value >= 0x80)
+	{
+		value >>= 7;
+		size++;
+	}
+	return size;
+}
 
-	OTEL_FUNC_LOGS(log_record__init)(&r->record);
-	OTEL_FUNC_COMMON(any_value__init)(&r->body);
+static inline void
+otel_EncodeRaw(struct otelEncoder *e, const void *data, size_t size)
+{
+	if (e->out != NULL)
+		memcpy(e->out + e->size, data, size);
+	e->size += size;
+}
 
-	r->record.attributes = r->attrList;
-	r->record.body = &r->body;
+static inline void
+otel_EncodeByte(struct otelEncoder *e, uint8_t value)
+{
+	if (e->out != NULL)
+		e->out[e->size] = value;
+	e->size++;
 }
 
-static void
-otel_LogAttributeInt(struct otelLogRecord *r, const char *key, int value);
+static inline void
+otel_EncodeVarint(struct otelEncoder *e, uint64 value)
+{
+	while (value >= 0x80)
+	{
+		otel_EncodeByte(e, (uint8_t) (value | 0x80));
+		value >>= 7;
+	}
+	otel_EncodeByte(e, (uint8_t) value);
+}
 
-static void
-otel_LogAttributeStr(struct otelLogRecord *r, const char *key, const char *value);
+static inline void
+otel_EncodeFixed64(struct otelEncoder *e, uint8_t tag, uint64 value)
+{
+	otel_EncodeByte(e, tag);
+	for (int i = 0; i < 8; i++)
+		otel_EncodeByte(e, (uint8_t) (value >> (8 * i)));
+}
+
+/* Write the tag and length of an embedded message or string */
+static inline void
+otel_EncodeLength(struct otelEncoder *e, uint8_t tag, size_t length)
+{
+	otel_EncodeByte(e, tag);
+	otel_EncodeVarint(e, length);
+}
+
+static inline void
+otel_EncodeString(struct otelEncoder *e, uint8_t tag,
+				  const char *value, size_t length)
+{
+	otel_EncodeLength(e, tag, length);
+	otel_EncodeRaw(e, value, length);
+}
+
+/* The size of an embedded message or string of length bytes, with its tag */
+static inline size_t
+otel_LengthSize(size_t length)
+{
+	return 1 + otel_VarintSize(length) + length;
+}
 
 struct otelResource
 {
@@ -0,0 +1,396 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "postgres.h"
+#include "storage/fd.h"
+#include "utils/memutils.h"
+
+#include "pg_otel_logs.h"
+#include "pg_otel_spill.h"
+
+/*
+ * The path of segment relative to the data directory. Segments of the first
+ * exporter have no suffix; the others end with the number of their channel.
+ */
+static void
+otel_SpillPath(char *path, const struct otelSpill *spill, uint32 segment)
+{
+	if (spill->channel == 0)
+		snprintf(path, MAXPGPATH, PG_OTEL_SPILL_DIRECTORY "/%08X", segment);
+	else
+		snprintf(path, MAXPGPATH, PG_OTEL_SPILL_DIRECTORY "/%08X.%d",
+				 segment, spill->channel);
+}
+
+/*
+ * Find segments left by a previous worker. They are read before anything new,
+ * and new requests go to a new segment in case the last one ends abruptly.
+ */
+static void
+otel_InitSpill(struct otelSpill *spill, int channel)
+{
+	DIR *dir;
+	struct dirent *de;
+	bool found = false;
+
+	spill->channel = channel;
+	spill->size = 0;
+	spill->read = spill->write = 0;
+	spill->readFile = spill->writeFile = -1;
+	spill->readOffset = spill->writeOffset = 0;
+	spill->reading = false;
+
+	dir = AllocateDir(PG_OTEL_SPILL_DIRECTORY);
+	if (dir == NULL && errno == ENOENT)
+		return;
+
+	while ((de = ReadDirExtended(dir, PG_OTEL_SPILL_DIRECTORY, LOG)) != NULL)
+	{
+		char path[MAXPGPATH];
+		struct stat st;
+		uint32 segment;
+
+		if (strspn(de->d_name, "0123456789ABCDEF") != 8)
+			continue;
+
+		segment = strtoul(de->d_name, NULL, 16);
+		otel_SpillPath(path, spill, segment);
+
+		/* Leave the segments of other exporters alone */
+		if (strcmp(path + sizeof(PG_OTEL_SPILL_DIRECTORY), de->d_name) != 0)
+			continue;
+
+		if (stat(path, &st) != 0)
+			continue;
+
+		if (!found || segment < spill->read)
+			spill->read = segment;
+		if (!found || segment >= spill->write)
+			spill->write = segment + 1;
+
+		spill->size += st.st_size;
+		found = true;
+	}
+
+	FreeDir(dir);
+}
+
+static void
+otel_CloseSpill(struct otelSpill *spill)
+{
+	if (spill->readFile >= 0)
+		close(spill->readFile);
+	if (spill->writeFile >= 0)
+		close(spill->writeFile);
+
+	spill->readFile = spill->writeFile = -1;
+}
+
+/* Whether there are requests to read */
+static bool
+otel_SpillPending(const struct otelSpill *spill)
+{
+	return spill->read != spill->write || spill->readOffset < spill->writeOffset;
+}
+
+/* Write size bytes at data to fd; returns false and sets errno otherwise */
+static bool
+otel_SpillWriteAll(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+
+	while (size > 0)
+	{
+		ssize_t n = write(fd, p, size);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return false;
+
+		/* Assume a short write means the disk is full */
+		if (n == 0)
+		{
+			errno = ENOSPC;
+			return false;
+		}
+
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+/*
+ * Append the pieces of body, a request of some log records, to the newest
+ * segment. This returns false when the request does not fit within sizeMax or
+ * cannot be written.
+ */
+static bool
+otel_SpillWrite(struct otelSpill *spill, const struct otelRequestBody *body,
+				int records)
+{
+	struct otelSpillEntry entry;
+	char path[MAXPGPATH];
+	bool ok;
+
+	if (spill->size + sizeof(entry) + body->size > spill->sizeMax ||
+		!AllocSizeIsValid(body->size))
+		return false;
+
+	/* Start a new segment when this one is full */
+	if (spill->writeFile >= 0 && spill->writeOffset >= PG_OTEL_SPILL_SEGMENT_SIZE)
+	{
+		close(spill->writeFile);
+		spill->writeFile = -1;
+		spill->writeOffset = 0;
+		spill->write++;
+	}
+
+	otel_SpillPath(path, spill, spill->write);
+
+	if (spill->writeFile < 0)
+	{
+		if (MakePGDirectory(PG_OTEL_SPILL_DIRECTORY) < 0 && errno != EEXIST)
+		{
+			ereport(WARNING,
+					(errcode_for_file_access(),
+					 errmsg("could not create directory \"%s\": %m",
+							PG_OTEL_SPILL_DIRECTORY)));
+			return false;
+		}
+
+		spill->writeFile = BasicOpenFile(path, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY);
+		if (spill->writeFile < 0)
+		{
+			ereport(WARNING,
+					(errcode_for_file_access(),
+					 errmsg("could not create file \"%s\": %m", path)));
+			return false;
+		}
+	}
+
+	entry.size = body->size;
+	entry.records = records;
+	entry.consumed = 0;
+	INIT_CRC32C(entry.crc);
+	for (int i = 0; i < body->length; i++)
+		COMP_CRC32C(entry.crc, body->pieces[i].data, body->pieces[i].size);
+	FIN_CRC32C(entry.crc);
+
+	ok = otel_SpillWriteAll(spill->writeFile, &entry, sizeof(entry));
+	for (int i = 0; ok && i < body->length; i++)
+		ok = otel_SpillWriteAll(spill->writeFile,
+								body->pieces[i].data, body->pieces[i].size);
+
+	if (!ok)
+	{
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m", path)));
+
+		/* Remove any part of this request so the segment can be read */
+		if (ftruncate(spill->writeFile, spill->writeOffset) != 0 ||
+			lseek(spill->writeFile, spill->writeOffset, SEEK_SET) < 0)
+		{
+			close(spill->writeFile);
+			spill->writeFile = -1;
+			spill->writeOffset = 0;
+			spill->write++;
+		}
+		return false;
+	}
+
+	spill->size += sizeof(entry) + body->size;
+	spill->writeOffset += sizeof(entry) + body->size;
+	return true;
+}
+
+/* Close and remove the oldest segment after reading all of it */
+static void
+otel_SpillRemove(struct otelSpill *spill)
+{
+	char path[MAXPGPATH];
+	struct stat st;
+
+	otel_SpillPath(path, spill, spill->read);
+
+	/* Bytes before readOffset were subtracted as they were read */
+	if (spill->readFile >= 0)
+	{
+		if (fstat(spill->readFile, &st) == 0 && st.st_size > spill->readOffset)
+			spill->size -= Min(spill->size, (size_t) (st.st_size - spill->readOffset));
+
+		close(spill->readFile);
+		spill->readFile = -1;
+	}
+
+	if (unlink(path) != 0 && errno != ENOENT)
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not remove file \"%s\": %m", path)));
+
+	spill->read++;
+	spill->readOffset = 0;
+}
+
+/*
+ * Move past size bytes of the oldest segment. When that is everything the
+ * writer has written, the segment is removed and the writer starts another.
+ */
+static void
+otel_SpillAdvance(struct otelSpill *spill, size_t size)
+{
+	spill->readOffset += size;
+	spill->size -= Min(spill->size, size);
+
+	if (spill->read == spill->write && spill->readOffset >= spill->writeOffset)
+	{
+		if (spill->writeFile >= 0)
+			close(spill->writeFile);
+
+		spill->writeFile = -1;
+		spill->writeOffset = 0;
+		spill->write++;
+
+		otel_SpillRemove(spill);
+	}
+}
+
+/*
+ * Read the oldest request into context. It stays in the queue until it is
+ * consumed or released. This returns NULL when there is nothing to read.
+ */
+static uint8_t *
+otel_SpillRead(struct otelSpill *spill, MemoryContext context,
+			   size_t *size, int *records)
+{
+	Assert(!spill->reading);
+
+	while (otel_SpillPending(spill))
+	{
+		struct otelSpillEntry entry;
+		char path[MAXPGPATH];
+		uint8_t *data = NULL;
+		pg_crc32c crc;
+
+		otel_SpillPath(path, spill, spill->read);
+
+		if (spill->readFile < 0)
+		{
+			spill->readFile = BasicOpenFile(path, O_RDWR | PG_BINARY);
+			if (spill->readFile < 0 && errno == ENOENT && spill->read != spill->write)
+			{
+				otel_SpillRemove(spill);
+				continue;
+			}
+			if (spill->readFile < 0)
+			{
+				ereport(WARNING,
+						(errcode_for_file_access(),
+						 errmsg("could not open file \"%s\": %m", path)));
+				return NULL;
+			}
+		}
+
+		if (pread(spill->readFile, &entry, sizeof(entry),
+				  spill->readOffset) == sizeof(entry) &&
+			AllocSizeIsValid(entry.size))
+		{
+			/* Skip requests that were sent before the worker restarted */
+			if (entry.consumed != 0)
+			{
+				otel_SpillAdvance(spill, sizeof(entry) + entry.size);
+				continue;
+			}
+
+			data = MemoryContextAllocExtended(context, Max(entry.size, 1),
+											  MCXT_ALLOC_NO_OOM);
+		}
+
+		if (data != NULL &&
+			pread(spill->readFile, data, entry.size,
+				  spill->readOffset + sizeof(entry)) == entry.size)
+		{
+			INIT_CRC32C(crc);
+			COMP_CRC32C(crc, data, entry.size);
+			FIN_CRC32C(crc);
+
+			if (EQ_CRC32C(crc, entry.crc))
+			{
+				spill->reading = true;
+				spill->readSize = sizeof(entry) + entry.size;
+				*size = entry.size;
+				*records = entry.records;
+				return data;
+			}
+		}
+
+		if (data != NULL)
+			pfree(data);
+
+		/*
+		 * The rest of this segment is missing or invalid. Skip it, but leave
+		 * the newest segment for the writer.
+		 */
+		if (spill->read == spill->write)
+		{
+			if (spill->readOffset < spill->writeOffset)
+				ereport(WARNING,
+						(errmsg("invalid request in file \"%s\" at offset %lld",
+								path, (long long) spill->readOffset)));
+
+			otel_SpillAdvance(spill, spill->writeOffset - spill->readOffset);
+			return NULL;
+		}
+
+		if (pread(spill->readFile, &entry, 1, spill->readOffset) > 0)
+			ereport(WARNING,
+					(errmsg("invalid request in file \"%s\" at offset %lld",
+							path, (long long) spill->readOffset)));
+
+		otel_SpillRemove(spill);
+	}
+
+	return NULL;
+}
+
+/*
+ * Remove the request that was read from the queue. It is marked in its header
+ * so that a later worker does not send it again.
+ */
+static void
+otel_SpillConsume(struct otelSpill *spill)
+{
+	uint32 consumed = 1;
+
+	Assert(spill->reading);
+
+	if (pwrite(spill->readFile, &consumed, sizeof(consumed),
+			   spill->readOffset + offsetof(struct otelSpillEntry, consumed))
+		!= sizeof(consumed))
+	{
+		char path[MAXPGPATH];
+
+		otel_SpillPath(path, spill, spill->read);
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m", path)));
+	}
+
+	spill->reading = false;
+	otel_SpillAdvance(spill, spill->readSize);
+}
+
+/* Keep the request that was read in the queue to be read again */
+static void
+otel_SpillRelease(struct otelSpill *spill)
+{
+	Assert(spill->reading);
+
+	spill->reading = false;
+}
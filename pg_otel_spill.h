@@ -0,0 +1,72 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#ifndef PG_OTEL_SPILL_H
+#define PG_OTEL_SPILL_H
+
+#include "postgres.h"
+#include "port/pg_crc32c.h"
+#include "utils/palloc.h"
+
+/* Relative to the data directory */
+#define PG_OTEL_SPILL_DIRECTORY "pg_otel"
+
+/* Segments are closed once they reach this size */
+#define PG_OTEL_SPILL_SEGMENT_SIZE (16 * 1024 * 1024)
+
+/*
+ * otelSpill is a queue of export requests in files on disk. Requests are
+ * appended to the newest segment and read from the oldest. Each one is marked
+ * in its header once it is sent, and a segment is removed once every request
+ * in it has been sent.
+ *
+ * Segment files are named by eight hexadecimal digits that increase, and each
+ * exporter has its own. Each request in a segment follows an otelSpillEntry
+ * header.
+ */
+struct otelSpillEntry
+{
+	uint32     size;
+	uint32     records;
+	uint32     consumed; /* nonzero once sent; see [otel_SpillConsume] */
+	pg_crc32c  crc;
+};
+
+struct otelSpill
+{
+	int    channel; /* of the exporter; see [otel_SpillPath] */
+	size_t size, sizeMax; /* bytes of requests not yet sent */
+
+	uint32 read, write; /* segment numbers */
+	int    readFile, writeFile;
+	off_t  readOffset, writeOffset;
+
+	bool   reading; /* a request has been read but not consumed */
+	size_t readSize;
+};
+
+struct otelRequestBody;
+
+static void
+otel_InitSpill(struct otelSpill *spill, int channel);
+
+static void
+otel_CloseSpill(struct otelSpill *spill);
+
+static bool
+otel_SpillPending(const struct otelSpill *spill);
+
+static bool
+otel_SpillWrite(struct otelSpill *spill, const struct otelRequestBody *body,
+				int records);
+
+static uint8_t *
+otel_SpillRead(struct otelSpill *spill, MemoryContext context,
+			   size_t *size, int *records);
+
+static void
+otel_SpillConsume(struct otelSpill *spill);
+
+static void
+otel_SpillRelease(struct otelSpill *spill);
+
+#endif
@@ -0,0 +1,241 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#include "postgres.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+
+#include "pg_otel.h"
+#include "pg_otel_ipc.h"
+#include "pg_otel_logs.h"
+#include "pg_otel_stat.h"
+
+/* The columns of pg_otel_stat(); see pg_otel--1.0.sql */
+#define PG_OTEL_STAT_COLUMNS 19
+
+/*
+ * Find or create the statistics in shared memory, one for each of count
+ * exporters. The caller should hold AddinShmemInitLock.
+ */
+static struct otelStat *
+otel_AttachStat(int count)
+{
+	struct otelStat *stat;
+	bool found;
+
+	stat = ShmemInitStruct(PG_OTEL_LIBRARY " stat",
+						   otel_StatSharedMemorySize(count), &found);
+
+	/* Counters start at zero, so they were last reset now */
+	if (!found)
+		for (int i = 0; i < count; i++)
+		{
+			MemSet(&stat[i], 0, sizeof(stat[i]));
+			SpinLockInit(&stat[i].mutex);
+			stat[i].reset = GetCurrentTimestamp();
+		}
+
+	return stat;
+}
+
+static Size
+otel_StatSharedMemorySize(int count)
+{
+	return MAXALIGN(mul_size(sizeof(struct otelStat), count));
+}
+
+/*
+ * Called by the background worker to copy its counters to shared memory. The
+ * counters of exporter go back to zero when there was a reset since the last
+ * time.
+ */
+static void
+otel_PublishStat(struct otelStat *stat, struct otelLogsExporter *exporter,
+				 struct otelIPC *ipc)
+{
+	struct otelLogsStats *stats = &exporter->stats;
+	uint64 bytesReset, droppedReset;
+	bool reset;
+
+	if (stat == NULL)
+		return;
+
+	SpinLockAcquire(&stat->mutex);
+	reset = stat->resetPending;
+	bytesReset = stat->ipcBytesReset;
+	droppedReset = stat->ipcDroppedReset;
+	stat->resetPending = false;
+	SpinLockRelease(&stat->mutex);
+
+	if (reset)
+		otel_ResetLogsStats(stats);
+
+	stats->ipcBytes = otel_IPCBytes(ipc) - bytesReset;
+	stats->ipcDropped = otel_IPCDropped(ipc) - droppedReset;
+
+	SpinLockAcquire(&stat->mutex);
+	if (!stat->resetPending)
+	{
+		stat->logs = *stats;
+		stat->exportsInFlight = exporter->exportsLength;
+	}
+	SpinLockRelease(&stat->mutex);
+}
+
+/* Add the counters of one exporter to those of others in sum */
+static void
+otel_SumStat(struct otelStat *sum, const struct otelStat *stat)
+{
+	struct otelLogsStats *to = &sum->logs;
+	const struct otelLogsStats *from = &stat->logs;
+
+	if (to->startUnixNano == 0 || from->startUnixNano < to->startUnixNano)
+		to->startUnixNano = from->startUnixNano;
+
+	to->received += from->received;
+	to->exported += from->exported;
+	for (int i = 0; i < lengthof(to->dropped); i++)
+		to->dropped[i] += from->dropped[i];
+	to->suppressed += from->suppressed;
+	to->collapsed += from->collapsed;
+	to->bytesSent += from->bytesSent;
+
+	/* Statuses beyond the first few distinct ones are not counted */
+	for (int i = 0; i < from->statusesLength; i++)
+	{
+		int j;
+
+		for (j = 0; j < to->statusesLength; j++)
+			if (to->statuses[j].status == from->statuses[i].status)
+				break;
+
+		if (j == to->statusesLength && j < PG_OTEL_EXPORT_STATUSES)
+		{
+			to->statuses[j].status = from->statuses[i].status;
+			to->statuses[j].count = 0;
+			to->statusesLength++;
+		}
+		if (j < to->statusesLength)
+			to->statuses[j].count += from->statuses[i].count;
+	}
+
+	for (int i = 0; i < lengthof(to->durations); i++)
+		to->durations[i] += from->durations[i];
+	to->durationCount += from->durationCount;
+	to->durationSum += from->durationSum;
+
+	to->ipcBytes += from->ipcBytes;
+	to->ipcDropped += from->ipcDropped;
+
+	if (from->lastErrorAt > to->lastErrorAt)
+	{
+		to->lastErrorAt = from->lastErrorAt;
+		strlcpy(to->lastError, from->lastError, sizeof(to->lastError));
+	}
+	to->lastSuccessAt = Max(to->lastSuccessAt, from->lastSuccessAt);
+
+	sum->exportsInFlight += stat->exportsInFlight;
+	sum->reset = Max(sum->reset, stat->reset);
+}
+
+/*
+ * Copy the stat of count exporters from shared memory into snapshot, adding
+ * them together.
+ */
+static void
+otel_ReadStat(struct otelStat *stat, int count, struct otelStat *snapshot)
+{
+	MemSet(snapshot, 0, sizeof(*snapshot));
+
+	for (int i = 0; i < count; i++)
+	{
+		struct otelStat one;
+
+		SpinLockAcquire(&stat[i].mutex);
+		one = stat[i];
+		SpinLockRelease(&stat[i].mutex);
+
+		otel_SumStat(snapshot, &one);
+	}
+}
+
+/*
+ * Set every counter in stat to zero. The background worker does the same to
+ * its own counters the next time it publishes.
+ */
+static void
+otel_ResetStat(struct otelStat *stat, struct otelIPC *ipc)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	uint64 bytes = otel_IPCBytes(ipc);
+	uint64 dropped = otel_IPCDropped(ipc);
+
+	SpinLockAcquire(&stat->mutex);
+	MemSet(&stat->logs, 0, sizeof(stat->logs));
+	stat->reset = now;
+	stat->resetPending = true;
+	stat->ipcBytesReset = bytes;
+	stat->ipcDroppedReset = dropped;
+	SpinLockRelease(&stat->mutex);
+}
+
+/* An array of int8 or float8 */
+static Datum
+otel_StatArray(Datum *values, int length, Oid type)
+{
+	return PointerGetDatum(construct_array(values, length, type, sizeof(int64),
+										   FLOAT8PASSBYVAL, 'd'));
+}
+
+/* Build one row of pg_otel_stat() from snapshot */
+static HeapTuple
+otel_StatTuple(const struct otelStat *snapshot, TupleDesc tupdesc)
+{
+	const struct otelLogsStats *logs = &snapshot->logs;
+	Datum bounds[PG_OTEL_EXPORT_DURATION_BOUNDS];
+	Datum counts[PG_OTEL_EXPORT_DURATION_BOUNDS + 1];
+	Datum values[PG_OTEL_STAT_COLUMNS];
+	bool  nulls[PG_OTEL_STAT_COLUMNS] = {};
+	int   i = 0;
+
+	StaticAssertStmt(lengthof(counts) == lengthof(logs->durations),
+					 "every duration bucket is a column");
+
+	for (int j = 0; j < lengthof(bounds); j++)
+		bounds[j] = Float8GetDatum(otel_ExportDurationBounds[j]);
+	for (int j = 0; j < lengthof(counts); j++)
+		counts[j] = Int64GetDatum((int64) logs->durations[j]);
+
+	values[i++] = Int64GetDatum((int64) logs->received);
+	values[i++] = Int64GetDatum((int64) logs->exported);
+	values[i++] = Int64GetDatum((int64) logs->ipcDropped);
+	values[i++] = Int64GetDatum((int64) logs->dropped[PG_OTEL_LOGS_DROPPED_QUEUE_FULL]);
+	values[i++] = Int64GetDatum((int64) logs->dropped[PG_OTEL_LOGS_DROPPED_INVALID]);
+	values[i++] = Int64GetDatum((int64) logs->dropped[PG_OTEL_LOGS_DROPPED_OVERSIZED]);
+	values[i++] = Int64GetDatum((int64) logs->dropped[PG_OTEL_LOGS_DROPPED_EXPORT]);
+	values[i++] = Int64GetDatum((int64) logs->suppressed);
+	values[i++] = Int64GetDatum((int64) logs->collapsed);
+	values[i++] = Int64GetDatum((int64) logs->ipcBytes);
+	values[i++] = Int64GetDatum((int64) logs->bytesSent);
+	values[i++] = Int32GetDatum(snapshot->exportsInFlight);
+
+	/* Timestamps are zero until something happens */
+	nulls[i] = (logs->lastErrorAt == 0);
+	values[i++] = CStringGetTextDatum(logs->lastError);
+	nulls[i] = (logs->lastErrorAt == 0);
+	values[i++] = TimestampTzGetDatum(logs->lastErrorAt);
+	nulls[i] = (logs->lastSuccessAt == 0);
+	values[i++] = TimestampTzGetDatum(logs->lastSuccessAt);
+
+	values[i++] = otel_StatArray(bounds, lengthof(bounds), FLOAT8OID);
+	values[i++] = otel_StatArray(counts, lengthof(counts), INT8OID);
+	values[i++] = Float8GetDatum(logs->durationSum);
+
+	nulls[i] = (snapshot->reset == 0);
+	values[i++] = TimestampTzGetDatum(snapshot->reset);
+
+	Assert(i == PG_OTEL_STAT_COLUMNS);
+	return heap_form_tuple(tupdesc, values, nulls);
+}
@@ -0,0 +1,55 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#ifndef PG_OTEL_STAT_H
+#define PG_OTEL_STAT_H
+
+#include "postgres.h"
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+#include "pg_otel_ipc.h"
+#include "pg_otel_logs.h"
+
+/*
+ * otelStat is what a background worker last published about itself, in
+ * shared memory so any backend can read it. Each exporter has its own. The
+ * worker keeps its own counters and copies them here; a reset from SQL takes
+ * effect here right away and in the worker the next time it publishes.
+ *
+ * IPC counters are shared by every backend and never go back to zero, so the
+ * values at the last reset are kept here and subtracted.
+ */
+struct otelStat
+{
+	slock_t mutex;
+
+	TimestampTz reset;
+	bool        resetPending;
+	uint64      ipcBytesReset, ipcDroppedReset;
+
+	struct otelLogsStats logs;
+	int exportsInFlight;
+};
+
+static struct otelStat *
+otel_AttachStat(int count);
+
+static Size
+otel_StatSharedMemorySize(int count);
+
+static void
+otel_PublishStat(struct otelStat *stat, struct otelLogsExporter *exporter,
+				 struct otelIPC *ipc);
+
+static void
+otel_ReadStat(struct otelStat *stat, int count, struct otelStat *snapshot);
+
+static void
+otel_ResetStat(struct otelStat *stat, struct otelIPC *ipc);
+
+static HeapTuple
+otel_StatTuple(const struct otelStat *snapshot, TupleDesc tupdesc);
+
+#endif
@@ -0,0 +1,132 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "storage/shmem.h"
+#include "utils/timestamp.h"
+
+#include "pg_otel.h"
+#include "pg_otel_config.h"
+#include "pg_otel_statement.h"
+
+/*
+ * Find or create the statement slots in shared memory, one set for each of
+ * count exporters. The caller should hold AddinShmemInitLock.
+ */
+static struct otelStatements *
+otel_AttachStatements(int count)
+{
+	struct otelStatements *statements;
+	bool found;
+
+	statements = ShmemInitStruct(PG_OTEL_LIBRARY " statements",
+								 otel_StatementsSharedMemorySize(count), &found);
+
+	if (!found)
+		for (int j = 0; j < count; j++)
+			for (int i = 0; i < PG_OTEL_STATEMENT_SLOTS; i++)
+			{
+				pg_atomic_init_u64(&statements[j].slots[i].key, 0);
+				pg_atomic_init_u64(&statements[j].slots[i].sentAt, 0);
+			}
+
+	return statements;
+}
+
+static Size
+otel_StatementsSharedMemorySize(int count)
+{
+	return MAXALIGN(mul_size(sizeof(struct otelStatements), count));
+}
+
+/*
+ * Called by a background worker when it starts, so that backends send every
+ * statement again to a worker that has not seen any. Each exporter has its
+ * own statements, because it keeps its own copies of their text.
+ */
+static void
+otel_ResetStatements(struct otelStatements *statements)
+{
+	if (statements == NULL)
+		return;
+
+	for (int i = 0; i < PG_OTEL_STATEMENT_SLOTS; i++)
+		pg_atomic_write_u64(&statements->slots[i].key, 0);
+}
+
+/*
+ * Called by the background worker when it drops a log record that carried the
+ * statement of key, so backends send the text again.
+ */
+static void
+otel_ForgetStatement(struct otelStatements *statements, uint64 key)
+{
+	struct otelStatementSlot *slot;
+	uint64 expected = key;
+
+	if (statements == NULL || key == 0)
+		return;
+
+	/* Leave the slot alone when another statement has taken it */
+	slot = &statements->slots[key % PG_OTEL_STATEMENT_SLOTS];
+	pg_atomic_compare_exchange_u64(&slot->key, &expected, 0);
+}
+
+/*
+ * Called by the background worker when it exports a log record with the
+ * statement of key, so backends leave the text out for a while.
+ */
+static void
+otel_MarkStatementSent(struct otelStatements *statements, uint64 key)
+{
+	struct otelStatementSlot *slot;
+
+	if (statements == NULL || key == 0)
+		return;
+
+	slot = &statements->slots[key % PG_OTEL_STATEMENT_SLOTS];
+
+	pg_atomic_write_u64(&slot->key, key);
+	pg_atomic_write_u64(&slot->sentAt, (uint64) GetCurrentTimestamp());
+}
+
+/*
+ * The key of a statement with queryId and text that hashes to hash. Texts of
+ * one query_id always have different keys. Returns zero when there is no
+ * query_id.
+ */
+static uint64
+otel_StatementKey(uint64 queryId, pg_crc32c hash)
+{
+	if (queryId == 0)
+		return 0;
+
+	/* query_id is already a hash */
+	return queryId ^ (((uint64) hash << 32) | hash);
+}
+
+/*
+ * Called by backends before sending a log message with the statement of key.
+ * Returns true when the background worker exported the text less than
+ * otel.logs_statement_dedup_interval ago, so this message can leave it out.
+ * Until the worker has exported it, every message carries the text.
+ *
+ * Postmaster stays out of shared memory, so it always sends the text.
+ */
+static bool
+otel_StatementSentRecently(struct otelStatements *statements,
+						   const struct otelConfiguration *config,
+						   uint64 key)
+{
+	struct otelStatementSlot *slot;
+
+	if (statements == NULL || !IsUnderPostmaster || key == 0 ||
+		config->logs.statementDedup == PG_OTEL_CONFIG_STATEMENT_DEDUP_OFF)
+		return false;
+
+	slot = &statements->slots[key % PG_OTEL_STATEMENT_SLOTS];
+
+	return pg_atomic_read_u64(&slot->key) == key &&
+		GetCurrentTimestamp() - (TimestampTz) pg_atomic_read_u64(&slot->sentAt) <
+		(TimestampTz) config->logs.statementDedupIntervalMS * 1000;
+}
@@ -0,0 +1,62 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#ifndef PG_OTEL_STATEMENT_H
+#define PG_OTEL_STATEMENT_H
+
+#include "postgres.h"
+#include "port/atomics.h"
+#include "port/pg_crc32c.h"
+
+#include "pg_otel_config.h"
+
+#define PG_OTEL_STATEMENT_SLOTS 1024
+
+/*
+ * otelStatementSlot is the statement whose text the background worker last
+ * exported and when. A statement is known by its key, which combines its
+ * query_id and a hash of its text; see [otel_StatementKey]. Executions of one
+ * query with different constants share a query_id but not a key.
+ *
+ * Each key has one slot, so two that share a slot push each other out and are
+ * sent more often. The two values are not read and written together; at worst
+ * a statement is sent again.
+ */
+struct otelStatementSlot
+{
+	pg_atomic_uint64 key;
+	pg_atomic_uint64 sentAt; /* TimestampTz */
+};
+
+/*
+ * otelStatements is in shared memory so every backend sends each text once to
+ * the same exporter.
+ */
+struct otelStatements
+{
+	struct otelStatementSlot slots[PG_OTEL_STATEMENT_SLOTS];
+};
+
+static struct otelStatements *
+otel_AttachStatements(int count);
+
+static Size
+otel_StatementsSharedMemorySize(int count);
+
+static void
+otel_ForgetStatement(struct otelStatements *statements, uint64 key);
+
+static void
+otel_MarkStatementSent(struct otelStatements *statements, uint64 key);
+
+static void
+otel_ResetStatements(struct otelStatements *statements);
+
+static uint64
+otel_StatementKey(uint64 queryId, pg_crc32c hash);
+
+static bool
+otel_StatementSentRecently(struct otelStatements *statements,
+						   const struct otelConfiguration *config,
+						   uint64 key);
+
+#endif
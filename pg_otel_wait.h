@@ -0,0 +1,53 @@
+/* vim: set noexpandtab autoindent cindent tabstop=4 shiftwidth=4 cinoptions="(0,t0": */
+
+#ifndef PG_OTEL_WAIT_H
+#define PG_OTEL_WAIT_H
+
+#include "postgres.h"
+
+#if PG_VERSION_NUM >= 140000
+#include "utils/wait_event.h"
+#else
+#include "pgstat.h"
+#endif
+
+/*
+ * otelWaitEvents are what pg_otel reports while it blocks or compresses. They
+ * have names in pg_stat_activity since PostgreSQL 17; before that, they are
+ * all the generic "Extension".
+ * - https://www.postgresql.org/docs/current/xfunc-c.html#XFUNC-ADDIN-WAIT-EVENTS
+ */
+struct otelWaitEvents
+{
+	uint32 ipcSend;  /* a backend writing to the pipe */
+	uint32 ipcRead;  /* the worker waiting for messages */
+	uint32 export;   /* the worker waiting on the collector */
+	uint32 compress; /* the worker compressing a request */
+	uint32 drain;    /* sending everything before shutdown */
+};
+
+static struct otelWaitEvents otel_WaitEvents = {
+	.ipcSend = PG_WAIT_EXTENSION,
+	.ipcRead = PG_WAIT_EXTENSION,
+	.export = PG_WAIT_EXTENSION,
+	.compress = PG_WAIT_EXTENSION,
+	.drain = PG_WAIT_EXTENSION,
+};
+
+/*
+ * Find or allocate the wait events in shared memory. Every process that calls
+ * this gets the same values.
+ */
+static void
+otel_InitWaitEvents(void)
+{
+#if PG_VERSION_NUM >= 170000
+	otel_WaitEvents.ipcSend = WaitEventExtensionNew("OtelIPCSend");
+	otel_WaitEvents.ipcRead = WaitEventExtensionNew("OtelIPCRead");
+	otel_WaitEvents.export = WaitEventExtensionNew("OtelExport");
+	otel_WaitEvents.compress = WaitEventExtensionNew("OtelCompress");
+	otel_WaitEvents.drain = WaitEventExtensionNew("OtelDrain");
+#endif
+}
+
+#endif
@@ -2,6 +2,9 @@
 
 #include "postgres.h"
 #include "miscadmin.h"
+#include "storage/latch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
 
 #if PG_VERSION_NUM >= 140000
 #include "utils/wait_event.h"
@@ -10,8 +13,14 @@
 #endif
 
 #include "pg_otel_config.h"
+#include "pg_otel_limit.h"
 #include "pg_otel_logs.h"
+#include "pg_otel_metrics.h"
+#include "pg_otel_pipeline.h"
 #include "pg_otel_proto.h"
+#include "pg_otel_stat.h"
+#include "pg_otel_statement.h"
+#include "pg_otel_wait.h"
 #include "pg_otel_ipc.c"
 
 struct otelWorker
@@ -19,8 +28,15 @@ struct otelWorker
 	sig_atomic_t volatile gotSIGHUP;
 	sig_atomic_t volatile gotSIGTERM;
 
-	struct otelIPC ipc;
+	/* One IPC channel for each exporter; see [otel_WorkerChannel] */
+	struct otelIPC *channels;
+	int channel, channelsLength;
 	int pid;
+
+	/* In shared memory, when it is attached; stat and statements by channel */
+	struct otelLimit *limit;
+	struct otelStat *stat;
+	struct otelStatements *statements;
 };
 
 struct otelWorkerExporter
@@ -28,6 +44,51 @@ struct otelWorkerExporter
 	struct otelLogsExporter logs;
 };
 
+/*
+ * otelWorkerSocket is one socket of a curl transfer and the events that
+ * curl is waiting for on it.
+ */
+struct otelWorkerSocket
+{
+	curl_socket_t fd;
+	int what; /* CURL_POLL_IN, CURL_POLL_OUT, or CURL_POLL_INOUT */
+};
+
+/*
+ * otelWorkerTransfers is a curl multi handle driven by the WaitEventSet of the
+ * background worker.
+ * - https://curl.se/libcurl/c/libcurl-multi.html
+ */
+struct otelWorkerTransfers
+{
+	CURLM *multi;
+	List  *sockets; /* struct otelWorkerSocket */
+	bool   socketsChanged;
+
+	bool        timer;
+	TimestampTz timerDeadline;
+};
+
+/*
+ * The channel this process uses. Exporters read from their own channel, and
+ * every other process sends to the channel of its process ID, so the messages
+ * of each backend stay in order.
+ */
+static int
+otel_WorkerChannel(const struct otelWorker *worker)
+{
+	if (MyProcPid == worker->pid)
+		return worker->channel;
+
+	return MyProcPid % worker->channelsLength;
+}
+
+static struct otelIPC *
+otel_WorkerIPC(struct otelWorker *worker)
+{
+	return &worker->channels[otel_WorkerChannel(worker)];
+}
+
 static void
 otel_WorkerReceive(void *ptr, bits8 signal, const uint8_t *message, size_t size)
 {
@@ -39,69 +100,414 @@ otel_WorkerReceive(void *ptr, bits8 signal, const uint8_t *message, size_t size)
 		otel_ReceiveLogMessage(&exporter->logs, message, size);
 }
 
+/*
+ * Read any messages from ipc and start sending batches to the collector. The
+ * pipe is read only when readable is true. Batches that are not due are sent
+ * only when flush is true. Returns true when there is nothing more to send.
+ */
 static bool
-otel_WorkerReadIPC(struct otelIPC *ipc, struct otelWorkerExporter *exporter, CURL *http)
+otel_WorkerReadIPC(struct otelIPC *ipc, bool readable, bool flush,
+				   struct otelWorkerExporter *exporter, CURLM *multi)
 {
 	Assert(exporter != NULL);
-	Assert(http != NULL);
+	Assert(multi != NULL);
 	Assert(ipc != NULL);
 
-	otel_ReceiveOverIPC(ipc, exporter, otel_WorkerReceive);
+	if (readable)
+		otel_ReceiveOverIPC(ipc, exporter, otel_WorkerReceive);
+
+	otel_ReceiveOverRing(ipc, exporter, otel_WorkerReceive);
+	otel_DiscardOrphans(ipc);
+
+	otel_StartLogsExports(&exporter->logs, multi, flush);
+
+	return exporter->logs.queueLength == 0 &&
+		exporter->logs.exportsLength == 0 && otel_IPCIsIdle(ipc);
+}
+
+/*
+ * Release any transfers that multi or the pipeline of exporter has finished.
+ */
+static void
+otel_WorkerFinishTransfers(struct otelWorkerExporter *exporter, CURLM *multi)
+{
+	struct otelLogsExport *export;
+	CURLMsg *msg;
+	int remaining;
+
+	while ((msg = curl_multi_info_read(multi, &remaining)) != NULL)
+	{
+		if (msg->msg == CURLMSG_DONE)
+			otel_FinishLogsExport(&exporter->logs, multi,
+								  msg->easy_handle, msg->data.result);
+	}
+
+	if (exporter->logs.pipeline != NULL)
+		while ((export = otel_PipelineFinished(exporter->logs.pipeline)) != NULL)
+			otel_FinishLogsExport(&exporter->logs, NULL, export->http, export->result);
+}
+
+/*
+ * Export a summary of log records that backends suppressed, once per second
+ * at most, with one record for each severity. The counts are taken right away
+ * when flush is true.
+ */
+static void
+otel_WorkerReportSuppressed(struct otelWorker *worker,
+							struct otelWorkerExporter *exporter, bool flush)
+{
+	static const int elevels[PG_OTEL_LIMIT_BUCKETS] = {
+		[PG_OTEL_LIMIT_DEBUG] = DEBUG1,
+		[PG_OTEL_LIMIT_INFO] = LOG,
+		[PG_OTEL_LIMIT_WARNING] = WARNING,
+		[PG_OTEL_LIMIT_ERROR] = ERROR,
+		[PG_OTEL_LIMIT_FATAL] = FATAL,
+	};
+	static TimestampTz reportedAt = 0;
+
+	TimestampTz now = GetCurrentTimestamp();
+
+	if (!flush && !TimestampDifferenceExceeds(reportedAt, now, 1000))
+		return;
 
-	if (exporter->logs.queueLength > 0)
-		otel_SendLogsToCollector(&exporter->logs, http);
+	for (int i = 0; i < PG_OTEL_LIMIT_BUCKETS; i++)
+	{
+		uint64 count = otel_TakeSuppressed(worker->limit, i);
+
+		if (count > 0)
+			otel_ReceiveSuppressedLogs(&exporter->logs, elevels[i], count);
+	}
 
-	return exporter->logs.queueLength == 0 && otel_IPCIsIdle(ipc);
+	reportedAt = now;
 }
 
+/*
+ * Send everything in one channel of worker to the collector. The pipe is read
+ * until EOF only when readPipe is true; the caller must have closed its write
+ * end.
+ */
 static void
-otel_WorkerDrain(struct otelWorker *worker, struct otelConfiguration *config)
+otel_WorkerDrain(struct otelWorker *worker, struct otelConfiguration *config,
+				 int channel, bool readPipe)
 {
 	struct otelWorkerExporter exporter = {};
-	CURL *http = curl_easy_init();
+	struct otelIPC *ipc = &worker->channels[channel];
+	CURLM *multi = curl_multi_init();
+	int running;
 
-	if (http == NULL)
+	if (multi == NULL)
 		ereport(FATAL, (errmsg("could not initialize curl for otel exporter")));
 
-	otel_InitLogsExporter(&exporter.logs, config);
+	otel_InitLogsExporter(&exporter.logs, config, channel);
 
 	for (;;)
 	{
-		if (otel_WorkerReadIPC(&worker->ipc, &exporter, http))
+		/* Backends may have suppressed records since the worker stopped */
+		otel_WorkerReportSuppressed(worker, &exporter, true);
+
+		if (otel_WorkerReadIPC(ipc, readPipe, true, &exporter, multi))
 			break;
+
+		/* Nothing else happens here, so wait on curl alone */
+		curl_multi_perform(multi, &running);
+		if (running > 0)
+		{
+			pgstat_report_wait_start(otel_WaitEvents.drain);
+			curl_multi_wait(multi, NULL, 0, 100, NULL);
+			pgstat_report_wait_end();
+		}
+
+		curl_multi_perform(multi, &running);
+		otel_WorkerFinishTransfers(&exporter, multi);
 	}
 
-	curl_easy_cleanup(http);
+	otel_SetRingLatch(ipc, NULL);
+	otel_CloseLogsExporter(&exporter.logs);
+	curl_multi_cleanup(multi);
+}
+
+/*
+ * Report messages that were dropped because the exporter fell behind or
+ * because they were too large to export. This goes only to the server log,
+ * at most once every ten seconds.
+ */
+static void
+otel_WorkerReportDropped(struct otelWorker *worker,
+						 const struct otelWorkerExporter *exporter)
+{
+	static uint64      reported = 0, reportedOversized = 0;
+	static TimestampTz reportedAt = 0;
+
+	const struct otelLogsStats *stats = &exporter->logs.stats;
+
+	uint64      dropped = stats->ipcDropped +
+		stats->dropped[PG_OTEL_LOGS_DROPPED_QUEUE_FULL] +
+		stats->dropped[PG_OTEL_LOGS_DROPPED_INVALID] +
+		stats->dropped[PG_OTEL_LOGS_DROPPED_EXPORT];
+	uint64      oversized = stats->dropped[PG_OTEL_LOGS_DROPPED_OVERSIZED];
+	TimestampTz now;
+
+	/* Counters go back to zero when statistics are reset */
+	if (dropped < reported || oversized < reportedOversized)
+		reported = reportedOversized = 0;
+
+	if (dropped <= reported && oversized <= reportedOversized)
+		return;
+
+	now = GetCurrentTimestamp();
+	if (!TimestampDifferenceExceeds(reportedAt, now, 10 * 1000))
+		return;
+
+	if (dropped > reported)
+		ereport(LOG,
+				(errmsg("otel exporter fell behind; " UINT64_FORMAT " messages were dropped",
+						dropped - reported)));
+
+	if (oversized > reportedOversized)
+		ereport(LOG,
+				(errmsg("otel exporter dropped " UINT64_FORMAT " log records larger than otel.otlp_max_request_size",
+						oversized - reportedOversized)));
+
+	reported = dropped;
+	reportedOversized = oversized;
+	reportedAt = now;
+}
+
+/*
+ * Track the sockets of curl transfers, as needed by [CURLMOPT_SOCKETFUNCTION].
+ */
+static int
+otel_WorkerSocketCallback(CURL *http, curl_socket_t fd, int what,
+						  void *userp, void *socketp)
+{
+	struct otelWorkerTransfers *transfers = userp;
+	struct otelWorkerSocket *sock = socketp;
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	if (what == CURL_POLL_REMOVE)
+	{
+		if (sock != NULL)
+		{
+			transfers->sockets = list_delete_ptr(transfers->sockets, sock);
+			pfree(sock);
+		}
+	}
+	else
+	{
+		if (sock == NULL)
+		{
+			sock = palloc(sizeof(*sock));
+			sock->fd = fd;
+			transfers->sockets = lappend(transfers->sockets, sock);
+			curl_multi_assign(transfers->multi, fd, sock);
+		}
+
+		sock->what = what;
+	}
+
+	/* The WaitEventSet must be built again */
+	transfers->socketsChanged = true;
+
+	MemoryContextSwitchTo(oldContext);
+	return 0;
+}
+
+/*
+ * Track when curl wants to be called next, as needed by
+ * [CURLMOPT_TIMERFUNCTION].
+ */
+static int
+otel_WorkerTimerCallback(CURLM *multi, long timeoutMS, void *userp)
+{
+	struct otelWorkerTransfers *transfers = userp;
+
+	transfers->timer = (timeoutMS >= 0);
+
+	if (transfers->timer)
+		transfers->timerDeadline =
+			TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeoutMS);
+
+	return 0;
+}
+
+/*
+ * Returns the milliseconds until deadline, but no more than timeout. A negative
+ * timeout means none.
+ */
+static long
+otel_WorkerTimeout(TimestampTz deadline, long timeout)
+{
+	long secs;
+	int  usecs;
+
+	TimestampDifference(GetCurrentTimestamp(), deadline, &secs, &usecs);
+
+	if (timeout < 0)
+		return secs * 1000 + usecs / 1000;
+
+	return Min(timeout, secs * 1000 + usecs / 1000);
+}
+
+/*
+ * Build a WaitEventSet for our process latch, IPC, pipeline, and the sockets
+ * of transfers. Curl sockets and the pipeline are the only events with user
+ * data.
+ */
+static WaitEventSet *
+otel_WorkerWaitEventSet(struct otelWorker *worker,
+						struct otelWorkerTransfers *transfers,
+						struct otelPipeline *pipeline)
+{
+	WaitEventSet *wes;
+	ListCell *cell;
+
+	wes = CreateWaitEventSet(CurrentMemoryContext,
+							 4 + list_length(transfers->sockets));
+	AddWaitEventToSet(wes, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+	AddWaitEventToSet(wes, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	otel_AddReadEventToSet(otel_WorkerIPC(worker), wes);
+	if (pipeline != NULL)
+		otel_AddPipelineEventToSet(pipeline, wes);
+
+	foreach(cell, transfers->sockets)
+	{
+		struct otelWorkerSocket *sock = lfirst(cell);
+		uint32 events = 0;
+
+		if (sock->what & CURL_POLL_IN)
+			events |= WL_SOCKET_READABLE;
+		if (sock->what & CURL_POLL_OUT)
+			events |= WL_SOCKET_WRITEABLE;
+
+		AddWaitEventToSet(wes, events, sock->fd, NULL, sock);
+	}
+
+	transfers->socketsChanged = false;
+	return wes;
 }
 
 static void
 otel_WorkerRun(struct otelWorker *worker, struct otelConfiguration *config)
 {
 	struct otelWorkerExporter exporter = {};
-	uint32 readEvent = 0;
-	WaitEventSet *wes;
-	CURL *http = curl_easy_init();
+	struct otelWorkerTransfers transfers = {};
+	struct otelIPC *ipc = otel_WorkerIPC(worker);
+	struct otelStat *stat = NULL;
+	WaitEventSet *wes = NULL;
+	TimestampTz metricsAt;
+	int running;
 
-	if (http == NULL)
+	transfers.multi = curl_multi_init();
+	if (transfers.multi == NULL)
 		ereport(FATAL, (errmsg("could not initialize curl for otel exporter")));
 
-	otel_InitLogsExporter(&exporter.logs, config);
+	curl_multi_setopt(transfers.multi, CURLMOPT_SOCKETFUNCTION, otel_WorkerSocketCallback);
+	curl_multi_setopt(transfers.multi, CURLMOPT_SOCKETDATA, &transfers);
+	curl_multi_setopt(transfers.multi, CURLMOPT_TIMERFUNCTION, otel_WorkerTimerCallback);
+	curl_multi_setopt(transfers.multi, CURLMOPT_TIMERDATA, &transfers);
 
-	/* Set up a WaitEventSet for our process latch and IPC */
-	wes = CreateWaitEventSet(CurrentMemoryContext, 3);
-	AddWaitEventToSet(wes, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
-	AddWaitEventToSet(wes, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
-	readEvent = otel_AddReadEventToSet(&worker->ipc, wes);
+	otel_InitLogsExporter(&exporter.logs, config, worker->channel);
+	if (config->exporterPipeline)
+		exporter.logs.pipeline = otel_StartPipeline();
+	if (worker->stat != NULL)
+	{
+		stat = &worker->stat[worker->channel];
+		otel_ResetStat(stat, ipc);
+	}
+	if (worker->statements != NULL)
+	{
+		exporter.logs.statementsSent = &worker->statements[worker->channel];
+		otel_ResetStatements(exporter.logs.statementsSent);
+	}
+	metricsAt = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+											config->metricExportIntervalMS);
+
+	/* Wake when backends write to shared memory, and check it right away */
+	otel_SetRingLatch(ipc, MyLatch);
+	SetLatch(MyLatch);
 
 	for (;;)
 	{
-		WaitEvent event = {};
-		bool idle = true;
+		WaitEvent events[8];
+		TimestampTz deadline;
+		bool idle, readable = false;
+		long timeout = -1;
+		uint32 waitEvent;
+		int n;
+
+		if (wes == NULL || transfers.socketsChanged)
+		{
+			if (wes != NULL)
+				FreeWaitEventSet(wes);
+			wes = otel_WorkerWaitEventSet(worker, &transfers, exporter.logs.pipeline);
+		}
+
+		/*
+		 * Wait for some work, until the next batch is due, or until curl needs
+		 * attention.
+		 */
+		if (transfers.timer)
+			timeout = otel_WorkerTimeout(transfers.timerDeadline, timeout);
+		if (otel_LogsExportDeadline(&exporter.logs, &deadline))
+			timeout = otel_WorkerTimeout(deadline, timeout);
+		if (otel_RepeatedLogsDeadline(&exporter.logs, &deadline))
+			timeout = otel_WorkerTimeout(deadline, timeout);
+		if (config->exports.signals & PG_OTEL_CONFIG_METRICS)
+			timeout = otel_WorkerTimeout(metricsAt, timeout);
+
+		/* Check every second for records that backends suppressed */
+		if (config->logs.rateLimit != NULL || config->logs.sampleRatio < 1)
+			timeout = (timeout < 0) ? 1000 : Min(timeout, 1000);
+
+		/* While stopping, check every second for the IPC to become idle */
+		if (worker->gotSIGTERM)
+			timeout = (timeout < 0) ? 1000 : Min(timeout, 1000);
 
-		/* Wait one second for some work */
-		WaitEventSetWait(wes, 1000, &event, 1, PG_WAIT_EXTENSION);
+		/* Report what the worker is waiting for, mostly */
+		if (worker->gotSIGTERM)
+			waitEvent = otel_WaitEvents.drain;
+		else if (exporter.logs.exportsLength > 0)
+			waitEvent = otel_WaitEvents.export;
+		else
+			waitEvent = otel_WaitEvents.ipcRead;
+
+		n = WaitEventSetWait(wes, timeout, events, lengthof(events), waitEvent);
 		ResetLatch(MyLatch);
 
+		for (int i = 0; i < n; i++)
+		{
+			int action = 0;
+
+			if (!(events[i].events & (WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE)))
+				continue;
+
+			if (events[i].user_data == NULL)
+			{
+				readable = true;
+				continue;
+			}
+
+			/* Exports that the pipeline finished are taken below */
+			if (events[i].user_data == exporter.logs.pipeline)
+				continue;
+
+			if (events[i].events & WL_SOCKET_READABLE)
+				action |= CURL_CSELECT_IN;
+			if (events[i].events & WL_SOCKET_WRITEABLE)
+				action |= CURL_CSELECT_OUT;
+
+			curl_multi_socket_action(transfers.multi, events[i].fd, action, &running);
+		}
+
+		if (transfers.timer &&
+			GetCurrentTimestamp() >= transfers.timerDeadline)
+		{
+			transfers.timer = false;
+			curl_multi_socket_action(transfers.multi, CURL_SOCKET_TIMEOUT, 0, &running);
+		}
+
+		otel_WorkerFinishTransfers(&exporter, transfers.multi);
+
 		if (worker->gotSIGHUP)
 		{
 			worker->gotSIGHUP = false;
@@ -110,8 +516,26 @@ otel_WorkerRun(struct otelWorker *worker, struct otelConfiguration *config)
 			otel_LoadLogsConfig(&exporter.logs, config);
 		}
 
-		if (event.events == readEvent)
-			idle = otel_WorkerReadIPC(&worker->ipc, &exporter, http);
+		/* Queue metrics about the exporter when they are due */
+		if (GetCurrentTimestamp() >= metricsAt)
+		{
+			if (config->exports.signals & PG_OTEL_CONFIG_METRICS &&
+				!worker->gotSIGTERM)
+				otel_QueueExporterMetrics(&exporter.logs,
+										  worker->channelsLength > 1 ?
+										  worker->channel : -1);
+
+			metricsAt = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+													config->metricExportIntervalMS);
+		}
+
+		otel_WorkerReportSuppressed(worker, &exporter, worker->gotSIGTERM);
+
+		idle = otel_WorkerReadIPC(ipc, readable, worker->gotSIGTERM,
+								  &exporter, transfers.multi);
+
+		otel_PublishStat(stat, &exporter.logs, ipc);
+		otel_WorkerReportDropped(worker, &exporter);
 
 		/*
 		 * Stop when the queues are empty and the IPC channel can be handed off
@@ -121,5 +545,11 @@ otel_WorkerRun(struct otelWorker *worker, struct otelConfiguration *config)
 			break;
 	}
 
-	curl_easy_cleanup(http);
+	otel_SetRingLatch(ipc, NULL);
+	if (exporter.logs.pipeline != NULL)
+		otel_StopPipeline(exporter.logs.pipeline);
+	exporter.logs.pipeline = NULL;
+	otel_CloseLogsExporter(&exporter.logs);
+	curl_multi_cleanup(transfers.multi);
+	FreeWaitEventSet(wes);
 }
@@ -10,8 +10,8 @@ SELECT name, setting, unit, context, vartype, min_val, max_val, enumvals
 -- TEST: endpoint requires scheme
 ALTER SYSTEM SET otel.otlp_endpoint TO 'localhost:8080';
 
--- TEST: protocol cannot be changed
-ALTER SYSTEM SET otel.otlp_protocol TO 'grpc';
+-- TEST: protocol is one of OTLP's
+ALTER SYSTEM SET otel.otlp_protocol TO 'http/json';
 
 -- TEST: attributes must be W3C Baggage
 ALTER SYSTEM SET otel.resource_attributes TO 'one=two, three=4 ';
@@ -23,3 +23,17 @@ ALTER SYSTEM RESET otel.resource_attributes;
 
 -- TEST: service.name cannot be blank
 ALTER SYSTEM SET otel.service_name TO '';
+
+-- TEST: SQLSTATE filter is codes and classes
+SET otel.logs_sqlstate_filter TO '08, -57014, 42P01';
+SET otel.logs_sqlstate_filter TO '-00';
+SET otel.logs_sqlstate_filter TO '4';
+SET otel.logs_sqlstate_filter TO '57-014';
+RESET otel.logs_sqlstate_filter;
+
+-- TEST: rate limit is a number and severities with their own
+ALTER SYSTEM SET otel.logs_rate_limit TO '20, error:100, fatal:0';
+ALTER SYSTEM SET otel.logs_rate_limit TO 'notice:5';
+ALTER SYSTEM SET otel.logs_rate_limit TO 'error:-1';
+ALTER SYSTEM SET otel.logs_rate_limit TO 'lots';
+ALTER SYSTEM RESET otel.logs_rate_limit;
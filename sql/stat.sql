@@ -0,0 +1,24 @@
+-- vim: set expandtab shiftwidth=0 syntax=pgsql tabstop=2 :
+
+CREATE EXTENSION pg_otel;
+
+-- TEST: statistics are visible in SQL
+SELECT received >= 0 AS received, exported >= 0 AS exported,
+       dropped_ipc >= 0 AS dropped, exports_in_flight >= 0 AS in_flight,
+       cardinality(export_duration_counts) = cardinality(export_duration_bounds) + 1 AS buckets,
+       stats_reset IS NOT NULL AS reset
+  FROM pg_otel_stat;
+
+-- TEST: statistics can be reset
+SELECT pg_otel_stat_reset();
+SELECT received, exported, dropped_queue_full, bytes_sent, last_error
+  FROM pg_otel_stat;
+
+-- TEST: only superusers can reset by default
+CREATE ROLE otel_stat_reader;
+SET ROLE otel_stat_reader;
+SELECT pg_otel_stat_reset();
+RESET ROLE;
+DROP ROLE otel_stat_reader;
+
+DROP EXTENSION pg_otel;
@@ -9,6 +9,7 @@ use Test::More;
 
 my $node = PostgreSQL::Test::Cluster->new('main');
 my $otlp_port = PostgreSQL::Test::Cluster::get_free_port();
+my $grpc_port = PostgreSQL::Test::Cluster::get_free_port();
 
 # Start the OpenTelemetry Collector
 my $otlp_file = $node->basedir() . '/otlp.ndjson';
@@ -19,6 +20,7 @@ eval
 	$collector = IPC::Run::start(
 	['otelcol', '--config', 'test/otel-collector.yaml',
 		'--set', "exporters.file.path=${otlp_file}",
+		'--set', "receivers.otlp.protocols.grpc.endpoint=localhost:${grpc_port}",
 		'--set', "receivers.otlp.protocols.http.endpoint=localhost:${otlp_port}"],
 	'2>', $node->basedir() . '/otelcol.log');
 };
@@ -9,6 +9,7 @@ use Test::More;
 
 my $node = PostgreSQL::Test::Cluster->new('main');
 my $otlp_port = PostgreSQL::Test::Cluster::get_free_port();
+my $grpc_port = PostgreSQL::Test::Cluster::get_free_port();
 
 # Start the OpenTelemetry Collector
 my $otlp_file = $node->basedir() . '/otlp.ndjson';
@@ -19,6 +20,7 @@ eval
 	$collector = IPC::Run::start(
 	['otelcol', '--config', 'test/otel-collector.yaml',
 		'--set', "exporters.file.path=${otlp_file}",
+		'--set', "receivers.otlp.protocols.grpc.endpoint=localhost:${grpc_port}",
 		'--set', "receivers.otlp.protocols.http.endpoint=localhost:${otlp_port}"],
 	'2>', $node->basedir() . '/otelcol.log');
 };
@@ -45,6 +47,301 @@ like($otlp_json, qr/
 	.+?"severityText":"LOG","body":\{"stringValue":"listening
 /sx, 'works for initial messages');
 
+
+# TEST: Events should be exported with gzip compression
+$node->append_conf('postgresql.conf', 'otel.otlp_compression = gzip');
+$node->reload();
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'compressed %', 'message'; END $$));
+
+my $gzip_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$gzip_json = slurp_file($otlp_file, length($otlp_json));
+	last if $gzip_json =~ /compressed message/;
+	sleep(1);
+}
+like($gzip_json, qr/
+	.+?"severityText":"LOG","body":\{"stringValue":"compressed\ message"
+/sx, 'works with gzip compression');
+
+
+# TEST: Events should be exported over gRPC
+$node->append_conf('postgresql.conf', qq(
+otel.otlp_endpoint = http://localhost:${grpc_port}
+otel.otlp_protocol = grpc
+));
+$node->reload();
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'grpc %', 'message'; END $$));
+
+my $grpc_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$grpc_json = slurp_file($otlp_file, length($otlp_json) + length($gzip_json));
+	last if $grpc_json =~ /grpc message/;
+	sleep(1);
+}
+like($grpc_json, qr/
+	.+?"severityText":"LOG","body":\{"stringValue":"grpc\ message"
+/sx, 'works over gRPC');
+
+
+# TEST: Metrics about the exporter should be exported
+$node->append_conf('postgresql.conf', qq(
+otel.export = 'logs, metrics'
+otel.metric_export_interval = 1000
+));
+$node->reload();
+
+my $metrics_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$metrics_json = slurp_file($otlp_file);
+	last if $metrics_json =~ /pg_otel\.logs\.received/;
+	sleep(1);
+}
+like($metrics_json, qr/
+	"name":"pg_otel\.logs\.received".+?"sum":\{"dataPoints":\[\{.+?"asInt":"\d+"
+/sx, 'exports metrics about the exporter');
+
+
+# TEST: Repeated events should be collapsed
+$node->append_conf('postgresql.conf', 'otel.logs_dedup_interval = 1000');
+$node->reload();
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'repeated %', 'message'; END $$)) for (1 .. 3);
+
+my $repeat_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$repeat_json = slurp_file($otlp_file);
+	last if $repeat_json =~ /pg_otel\.repeat\.count/;
+	sleep(1);
+}
+like($repeat_json, qr/
+	"stringValue":"repeated\ message".+?
+	"key":"pg_otel\.repeat\.count","value":\{"intValue":"2"\}
+/sx, 'collapses repeated messages');
+
+
+# TEST: Statements with the same query_id should be sent once
+$node->append_conf('postgresql.conf', q(
+compute_query_id = on
+otel.logs_dedup_interval = 0
+otel.logs_statement_dedup = 'omit'
+));
+$node->reload();
+
+# Backends leave out the text only once it has been exported
+my $statement_json = '';
+foreach my $count (1 .. 2)
+{
+	$node->psql('postgres', 'SELECT 1/0 AS statement_dedup');
+	foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+	{
+		$statement_json = slurp_file($otlp_file, length($repeat_json));
+		last if (() = $statement_json =~ /"stringValue":"division by zero"/g) >= $count;
+		sleep(1);
+	}
+}
+is((() = $statement_json =~ /SELECT 1\/0 AS statement_dedup/g), 1,
+	'sends each statement once');
+like($statement_json, qr/"key":"db\.postgresql\.query_id"/,
+	'exports query_id');
+
+
+# TEST: Statements should be put back on records even when the first one was
+# exported long after it arrived. Records wait longer than twice the interval,
+# so the exporter must keep the text from when it is exported.
+$node->append_conf('postgresql.conf', q(
+otel.blrp_schedule_delay = 7000
+otel.logs_statement_dedup = 'reattach'
+otel.logs_statement_dedup_interval = 3000
+));
+$node->reload();
+
+my $offset = -s $otlp_file;
+my $reattach_json = '';
+foreach my $sql ('SELECT 1/0 AS reattach', 'SELECT 1/0 AS reattach', 'SELECT 2/0 AS reattach')
+{
+	my $count = () = $reattach_json =~ /"stringValue":"division by zero"/g;
+
+	$node->psql('postgres', $sql);
+	foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+	{
+		$reattach_json = slurp_file($otlp_file, $offset);
+		last if (() = $reattach_json =~ /"stringValue":"division by zero"/g) > $count;
+		sleep(1);
+	}
+}
+is((() = $reattach_json =~ /"stringValue":"SELECT 1\/0 AS reattach"/g), 2,
+	'puts statements back after a delayed export');
+is((() = $reattach_json =~ /"stringValue":"SELECT 2\/0 AS reattach"/g), 1,
+	'puts back only the same text of a query_id');
+
+$node->append_conf('postgresql.conf', 'otel.blrp_schedule_delay = 1000');
+
+
+# TEST: Every exporter worker should export the logs of its backends
+$node->append_conf('postgresql.conf', q(
+otel.exporter_workers = 2
+otel.logs_statement_dedup = 'off'
+));
+$node->restart();
+$node->safe_psql('postgres', qq(DO \$\$ BEGIN RAISE LOG 'sharded %', $_; END \$\$))
+	for (1 .. 8);
+
+is($node->safe_psql('postgres', q(
+	SELECT count(*) FROM pg_stat_activity
+	 WHERE backend_type LIKE 'OpenTelemetry exporter %')), '2',
+	'starts two exporters');
+
+my $sharded_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$sharded_json = slurp_file($otlp_file, length($statement_json));
+	last if (() = $sharded_json =~ /sharded \d/g) >= 8;
+	sleep(1);
+}
+is((() = $sharded_json =~ /"stringValue":"sharded \d"/g), 8,
+	'exports from every channel');
+
+
+# TEST: Events should be exported by a pipeline thread
+$node->append_conf('postgresql.conf', 'otel.exporter_pipeline = on');
+$node->restart();
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'pipelined %', 'message'; END $$));
+
+my $pipeline_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$pipeline_json = slurp_file($otlp_file, length($sharded_json));
+	last if $pipeline_json =~ /pipelined message/;
+	sleep(1);
+}
+like($pipeline_json, qr/"stringValue":"pipelined message"/,
+	'works with a pipeline thread');
+
+
+# TEST: Log records excluded by severity or SQLSTATE should not be exported
+$offset = -s $otlp_file;
+$node->safe_psql('postgres', q(
+SET otel.logs_min_level = warning;
+SET otel.logs_sqlstate_filter = '-22012';
+DO $$ BEGIN
+	RAISE LOG 'filtered by level';
+	RAISE WARNING 'filtered by sqlstate' USING ERRCODE = 'division_by_zero';
+	RAISE WARNING 'passed the exclusion';
+END $$;
+SET otel.logs_sqlstate_filter = '22';
+DO $$ BEGIN
+	RAISE WARNING 'filtered by class';
+	RAISE WARNING 'passed the class' USING ERRCODE = 'division_by_zero';
+END $$;
+));
+
+my $filter_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$filter_json = slurp_file($otlp_file, $offset);
+	last if $filter_json =~ /passed the class/;
+	sleep(1);
+}
+like($filter_json, qr/"stringValue":"passed the exclusion"/,
+	'exports records that pass the filters');
+like($filter_json, qr/"stringValue":"passed the class"/,
+	'exports records of an included SQLSTATE class');
+unlike($filter_json, qr/filtered by/, 'leaves out filtered records');
+
+
+# TEST: Log records beyond the rate limit should be counted in a summary
+$offset = -s $otlp_file;
+$node->append_conf('postgresql.conf', 'otel.logs_rate_limit = 5');
+$node->reload();
+$node->safe_psql('postgres', q(DO $$ BEGIN
+	FOR i IN 1..50 LOOP RAISE WARNING 'limited %', i; END LOOP;
+END $$));
+
+my ($limited, $suppressed) = (0, 0);
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	my $limit_json = slurp_file($otlp_file, $offset);
+	$limited = () = $limit_json =~ /"stringValue":"limited \d+"/g;
+	$suppressed = 0;
+	$suppressed += $_
+	  for ($limit_json =~ /"stringValue":"(\d+) similar log records were suppressed"/g);
+	last if $limited + $suppressed >= 50;
+	sleep(1);
+}
+cmp_ok($limited, '>=', 5, 'exports records within the rate limit');
+cmp_ok($limited, '<', 50, 'suppresses records beyond the rate limit');
+is($limited + $suppressed, 50, 'counts suppressed records in a summary');
+
+$node->append_conf('postgresql.conf', 'otel.logs_rate_limit = 0');
+$node->reload();
+
+
+# TEST: Attribute values should be cut on a character boundary
+$offset = -s $otlp_file;
+$node->safe_psql('postgres',
+	q(CREATE DATABASE utf8 ENCODING 'UTF8' LOCALE 'C' TEMPLATE template0));
+$node->append_conf('postgresql.conf', 'otel.attribute_value_length_limit = 5');
+$node->reload();
+$node->safe_psql('utf8',
+	qq(/* \x{c3}\x{a9}\x{c3}\x{a9}\x{c3}\x{a9} */ DO \$\$ BEGIN RAISE LOG 'truncated %', 'message'; END \$\$));
+
+my $truncated_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$truncated_json = slurp_file($otlp_file, $offset);
+	last if $truncated_json =~ /truncated message/;
+	sleep(1);
+}
+like($truncated_json,
+	qr/"key":"db\.statement","value":\{"stringValue":"\/\* \x{c3}\x{a9}\x{c3}\x{a9}"\}/,
+	'cuts attribute values to whole characters');
+
+
+# TEST: Attributes beyond the limit should be dropped and counted
+$offset = -s $otlp_file;
+$node->append_conf('postgresql.conf', qq(
+otel.attribute_count_limit = 2
+otel.attribute_value_length_limit = -1
+));
+$node->reload();
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'counted %', 'message'; END $$));
+
+my $counted_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$counted_json = slurp_file($otlp_file, $offset);
+	last if $counted_json =~ /counted message/;
+	sleep(1);
+}
+my ($attributes, $dropped) = $counted_json =~ /
+	"body":\{"stringValue":"counted\ message"\},
+	"attributes":\[(.*?)\],"droppedAttributesCount":(\d+)
+/x;
+ok(defined($dropped), 'exports dropped_attributes_count');
+is((() = ($attributes // '') =~ /"key":/g), 2, 'keeps attributes up to the limit');
+cmp_ok($dropped // 0, '>', 0, 'counts the attributes beyond the limit');
+
+$node->append_conf('postgresql.conf', 'otel.attribute_count_limit = 128');
+$node->reload();
+
+
+# TEST: Statistics should count each log message the exporter receives
+$node->safe_psql('postgres', 'CREATE EXTENSION pg_otel');
+my $received = $node->safe_psql('postgres', 'SELECT received FROM pg_otel_stat');
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'received %', 'message'; END $$));
+
+my $received_after = $received;
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$received_after = $node->safe_psql('postgres', 'SELECT received FROM pg_otel_stat');
+	last if $received_after > $received;
+	sleep(1);
+}
+cmp_ok($received_after, '>', $received, 'counts received log messages');
+
 # Stop PostgreSQL
 $node->stop();
 
@@ -0,0 +1,134 @@
+use strict;
+use warnings;
+
+use IPC::Run ();
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+
+my $node = PostgreSQL::Test::Cluster->new('main');
+my $otlp_port = PostgreSQL::Test::Cluster::get_free_port();
+my $grpc_port = PostgreSQL::Test::Cluster::get_free_port();
+my $otlp_file = $node->basedir() . '/otlp.ndjson';
+
+if (system('otelcol', '--version') != 0)
+{
+	plan skip_all => 'otelcol (OpenTelemetry Collector) is needed to run this test';
+}
+
+# Start PostgreSQL with logs enabled before there is a collector
+$node->init();
+$node->append_conf('postgresql.conf', qq(
+shared_preload_libraries = pg_otel
+
+otel.blrp_schedule_delay = 100
+otel.export = logs
+otel.otlp_endpoint = http://localhost:${otlp_port}
+otel.spill_max_size = 1MB
+));
+$node->start();
+
+
+# TEST: Batches that could not be sent should be written to disk
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'spilled %', 'message'; END $$));
+
+my $spill_dir = $node->data_dir() . '/pg_otel';
+my $spilled = 0;
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$spilled = grep { -s $_ } glob("${spill_dir}/*");
+	last if $spilled;
+	sleep(1);
+}
+ok($spilled, 'writes batches to disk');
+
+
+# Start the OpenTelemetry Collector
+sub start_collector
+{
+	return IPC::Run::start(
+		['otelcol', '--config', 'test/otel-collector.yaml',
+			'--set', "exporters.file.path=${otlp_file}",
+			'--set', "receivers.otlp.protocols.grpc.endpoint=localhost:${grpc_port}",
+			'--set', "receivers.otlp.protocols.http.endpoint=localhost:${otlp_port}"],
+		'2>>', $node->basedir() . '/otelcol.log');
+}
+
+# The total size of files on disk
+sub spill_size
+{
+	my $size = 0;
+	$size += -s $_ for glob("${spill_dir}/*");
+	return $size;
+}
+
+{ open my $fh, '>', $otlp_file; close $fh; };
+my $collector = start_collector();
+
+
+# TEST: Batches on disk should be sent once the collector is available
+my $otlp_json = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$otlp_json = slurp_file($otlp_file);
+	last if $otlp_json =~ /spilled message/;
+	sleep(1);
+}
+like($otlp_json, qr/
+	.+?"severityText":"LOG","body":\{"stringValue":"spilled\ message"
+/sx, 'sends batches from disk');
+
+
+
+# TEST: Disk space should be freed as batches are sent, so a spill smaller
+# than one segment can fill again
+$collector->kill_kill();
+$node->append_conf('postgresql.conf', 'otel.blrp_max_export_batch_size = 64');
+$node->reload();
+
+foreach my $round ('filled', 'refilled')
+{
+	$node->safe_psql('postgres', qq(DO \$\$ BEGIN
+		FOR i IN 1..2000 LOOP RAISE LOG '${round} % %', i, repeat('x', 1000); END LOOP;
+	END \$\$));
+
+	my $size = 0;
+	foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+	{
+		$size = spill_size();
+		last if $size >= 768 * 1024;
+		sleep(1);
+	}
+	cmp_ok($size, '>=', 768 * 1024, "${round} disk up to otel.spill_max_size");
+	cmp_ok($size, '<=', 1024 * 1024, "${round} disk within otel.spill_max_size");
+
+	$collector = start_collector();
+	foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+	{
+		$size = spill_size();
+		last if $size == 0;
+		sleep(1);
+	}
+	is($size, 0, "${round} disk is emptied once batches are sent");
+	$collector->kill_kill();
+}
+
+
+# TEST: Batches that were sent should not be sent again after a restart
+$collector = start_collector();
+$node->restart();
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'restarted %', 'message'; END $$));
+
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$otlp_json = slurp_file($otlp_file);
+	last if $otlp_json =~ /restarted message/;
+	sleep(1);
+}
+is((() = $otlp_json =~ /"stringValue":"spilled message"/g), 1,
+	'sends batches from disk once');
+
+$node->stop();
+$collector->kill_kill();
+
+done_testing();
@@ -0,0 +1,132 @@
+use strict;
+use warnings;
+
+use Digest::MD5 qw(md5_hex);
+use IO::Socket::INET;
+use IO::Uncompress::Gunzip qw(gunzip);
+use POSIX ();
+use PostgreSQL::Test::Cluster;
+use PostgreSQL::Test::Utils;
+use Test::More;
+
+my $node = PostgreSQL::Test::Cluster->new('main');
+my $requests_file = $node->basedir() . '/requests.txt';
+
+# Read one HTTP/1.1 request from a client and return its decompressed body,
+# or undef when the client closes the connection.
+sub read_request
+{
+	my ($client) = @_;
+	my ($chunked, $gzip, $length, $body) = (0, 0, 0, '');
+
+	my $line = <$client>;
+	return undef unless defined $line;
+
+	while (defined($line = <$client>) && $line ne "\r\n")
+	{
+		$chunked = 1 if $line =~ /^Transfer-Encoding:\s*chunked/i;
+		$gzip = 1 if $line =~ /^Content-Encoding:\s*gzip/i;
+		$length = $1 if $line =~ /^Content-Length:\s*(\d+)/i;
+	}
+
+	if ($chunked)
+	{
+		while (defined($line = <$client>) && hex($line) > 0)
+		{
+			read($client, my $chunk, hex($line));
+			$body .= $chunk;
+			<$client>;
+		}
+		<$client>;
+	}
+	else
+	{
+		read($client, $body, $length);
+	}
+
+	return $body unless $gzip;
+
+	my $plain;
+	return gunzip(\$body => \$plain) ? $plain : 'corrupt';
+}
+
+# Start a collector that forgets the second request on its first connection
+# without a response. Curl sees that connection die after reusing it, so it
+# rewinds the request body and sends it again on a new connection.
+my $server = IO::Socket::INET->new(
+	LocalAddr => '127.0.0.1', LocalPort => 0, Listen => 10, ReuseAddr => 1)
+  or die "could not listen: $!";
+my $otlp_port = $server->sockport();
+{ open my $fh, '>', $requests_file; close $fh; };
+
+my $collector = fork();
+if ($collector == 0)
+{
+	my $connections = 0;
+	while (my $client = $server->accept())
+	{
+		$connections++;
+		next if fork() != 0;
+
+		my $requests = 0;
+		while (defined(my $body = read_request($client)))
+		{
+			open my $fh, '>>', $requests_file;
+			$fh->autoflush(1);
+			$requests++;
+
+			if ($connections == 1 && $requests == 2)
+			{
+				print $fh 'dropped ' . md5_hex($body) . "\n";
+				last;
+			}
+
+			print $fh 'received ' . md5_hex($body) . ($body =~ /rewound message/ ? ' rewound' : '') . "\n";
+			print $client "HTTP/1.1 200 OK\r\nContent-Type: application/x-protobuf\r\nContent-Length: 0\r\n\r\n";
+		}
+		close $client;
+		POSIX::_exit(0);
+	}
+	POSIX::_exit(0);
+}
+close $server;
+
+# Start PostgreSQL with compressed logs
+$node->init();
+$node->append_conf('postgresql.conf', qq(
+shared_preload_libraries = pg_otel
+
+otel.blrp_schedule_delay = 100
+otel.export = logs
+otel.otlp_compression = gzip
+otel.otlp_endpoint = http://127.0.0.1:${otlp_port}
+));
+$node->start();
+
+my $requests = '';
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$requests = slurp_file($requests_file);
+	last if $requests =~ /^received/m;
+	sleep(1);
+}
+
+
+# TEST: A compressed body should be the same after curl rewinds it
+$node->safe_psql('postgres', q(DO $$ BEGIN RAISE LOG 'rewound %', 'message'; END $$));
+
+foreach (1 .. $PostgreSQL::Test::Utils::timeout_default)
+{
+	$requests = slurp_file($requests_file);
+	last if $requests =~ /^dropped (\w+)$.*^received \1/ms && $requests =~ / rewound$/m;
+	sleep(1);
+}
+like($requests, qr/^dropped (\w+)$.*^received \1/ms, 'sends a compressed body again');
+unlike($requests, qr/^received \Q@{[md5_hex('corrupt')]}\E/m, 'sends valid gzip');
+like($requests, qr/ rewound$/m, 'exports the message');
+
+$node->stop();
+kill 'KILL', $collector;
+waitpid($collector, 0);
+
+done_testing();